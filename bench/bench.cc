@@ -0,0 +1,687 @@
+// Micro-benchmarks for ordered_forest.
+//
+// Usage: bench [-n SIZE] [NAME...]
+//
+// Runs every benchmark whose name begins with one of the given NAMEs, or all
+// benchmarks if none are given, on forests of SIZE nodes (default 1000000).
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "compact_forest.h"
+#include "indexed_forest.h"
+#include "ordered_forest.h"
+
+// Allocator that tallies bytes currently allocated, for memory comparisons.
+
+std::size_t counted_bytes = 0;
+
+template <typename T>
+struct counting_allocator {
+    using value_type = T;
+
+    counting_allocator() = default;
+    template <typename U>
+    counting_allocator(const counting_allocator<U>&) noexcept {}
+
+    T* allocate(std::size_t n) {
+        counted_bytes += n*sizeof(T);
+        return std::allocator<T>{}.allocate(n);
+    }
+
+    void deallocate(T* p, std::size_t n) {
+        counted_bytes -= n*sizeof(T);
+        std::allocator<T>{}.deallocate(p, n);
+    }
+
+    bool operator==(const counting_allocator&) const { return true; }
+    bool operator!=(const counting_allocator&) const { return false; }
+};
+
+using forest = ordered_forest<int>;
+using pooled_forest = ordered_forest<int, std::allocator<int>, forest_node_pool>;
+using threaded_forest = ordered_forest<int, std::allocator<int>, forest_preorder_thread>;
+using sized_forest = ordered_forest<int, std::allocator<int>, forest_subtree_size>;
+using lazy_parent_forest = ordered_forest<int, std::allocator<int>, forest_lazy_parent|forest_last_child>;
+using linked_forest = ordered_forest<int, std::allocator<int>, forest_prev_sibling>;
+using indexed = indexed_forest<int>;
+
+// Forest shapes: a single chain, a single root with n-1 children, and a
+// random tree where each node is attached as the first child of a uniformly
+// chosen earlier node.
+
+template <typename F>
+F make_deep(std::size_t n) {
+    F f;
+    if (!n) return f;
+
+    auto i = f.push_front(0);
+    for (std::size_t k = 1; k<n; ++k) i = f.push_child(i, int(k));
+    return f;
+}
+
+template <typename F>
+F make_wide(std::size_t n) {
+    F f;
+    if (!n) return f;
+
+    auto i = f.push_front(0);
+    for (std::size_t k = 1; k<n; ++k) f.push_child(i, int(k));
+    return f;
+}
+
+template <typename F>
+F make_random(std::size_t n, unsigned seed = 1) {
+    F f;
+    if (!n) return f;
+
+    std::minstd_rand R(seed);
+    std::vector<typename F::iterator> nodes;
+    nodes.reserve(n);
+
+    nodes.push_back(f.push_front(0));
+    for (std::size_t k = 1; k<n; ++k) {
+        std::uniform_int_distribution<std::size_t> U(0, k-1);
+        nodes.push_back(f.push_child(nodes[U(R)], int(k)));
+    }
+    return f;
+}
+
+// Copy through the public insertion interface, as ordered_forest's copy
+// constructor formerly did (but with an explicit stack).
+
+template <typename F>
+F naive_copy(const F& src) {
+    using sibling_iterator = typename F::sibling_iterator;
+    using const_sibling_iterator = typename F::const_sibling_iterator;
+
+    F f;
+    std::vector<std::pair<const_sibling_iterator, sibling_iterator>> stack;
+
+    sibling_iterator j;
+    for (auto i = src.root_begin(); i!=src.root_end(); ++i) {
+        j = j? f.insert_after(j, *i): sibling_iterator(f.push_front(*i));
+        stack.push_back({i, j});
+
+        while (!stack.empty()) {
+            auto p = stack.back();
+            stack.pop_back();
+
+            sibling_iterator k;
+            for (auto c = src.child_begin(p.first); c!=src.child_end(p.first); ++c) {
+                k = k? f.insert_after(k, *c): sibling_iterator(f.push_child(p.second, *c));
+                stack.push_back({c, k});
+            }
+        }
+    }
+    return f;
+}
+
+// Benchmark registry and timing.
+
+struct benchmark {
+    std::string name;
+    std::function<void (std::size_t)> run;
+};
+
+std::vector<benchmark>& registry() {
+    static std::vector<benchmark> r;
+    return r;
+}
+
+struct register_benchmark {
+    register_benchmark(std::string name, std::function<void (std::size_t)> run) {
+        registry().push_back({std::move(name), std::move(run)});
+    }
+};
+
+// Best of reps wall-clock times for f(), in milliseconds.
+
+template <typename Fn>
+double time_ms(Fn&& f, int reps = 5) {
+    using clock = std::chrono::steady_clock;
+    double best = 0;
+
+    for (int r = 0; r<reps; ++r) {
+        auto t0 = clock::now();
+        f();
+        double ms = std::chrono::duration<double, std::milli>(clock::now()-t0).count();
+        if (!r || ms<best) best = ms;
+    }
+    return best;
+}
+
+void report(const std::string& name, const char* variant, double ms, std::size_t n) {
+    std::printf("%-24s %-16s %10.3f ms %8.2f ns/node\n", name.c_str(), variant, ms, 1e6*ms/n);
+}
+
+// Copy: ordered_forest copy constructor versus insertion-based copy.
+
+template <typename F>
+void bench_copy(const std::string& name, const F& f, std::size_t n) {
+    report(name, "naive", time_ms([&] { F g = naive_copy(f); }), n);
+    report(name, "copy", time_ms([&] { F g(f); }), n);
+}
+
+register_benchmark copy_deep("copy/deep", [](std::size_t n) { bench_copy("copy/deep", make_deep<forest>(n), n); });
+register_benchmark copy_wide("copy/wide", [](std::size_t n) { bench_copy("copy/wide", make_wide<forest>(n), n); });
+register_benchmark copy_random("copy/random", [](std::size_t n) { bench_copy("copy/random", make_random<forest>(n), n); });
+register_benchmark copy_random_pooled("copy/random/pooled", [](std::size_t n) {
+    bench_copy("copy/random/pooled", make_random<pooled_forest>(n), n);
+});
+
+// Layout: traversal time and memory of pointer-linked nodes (individually
+// allocated or pooled) versus 32-bit index links in a contiguous array. The
+// copies are built in preorder, so have better locality than the originals.
+
+template <typename F>
+long long preorder_sum(const F& f) {
+    long long s = 0;
+    for (auto i = f.begin(); i!=f.end(); ++i) s += *i;
+    return s;
+}
+
+template <typename F>
+long long postorder_sum(const F& f) {
+    long long s = 0;
+    for (auto i = f.postorder_begin(); i!=f.postorder_end(); ++i) s += *i;
+    return s;
+}
+
+volatile long long sink;
+
+template <typename F>
+void bench_traverse(const std::string& name, const char* variant, const F& f, std::size_t n) {
+    report(name+"/pre", variant, time_ms([&] { sink = preorder_sum(f); }), n);
+    report(name+"/post", variant, time_ms([&] { sink = postorder_sum(f); }), n);
+}
+
+template <typename F>
+void report_memory(const std::string& name, const char* variant, F (*make)(std::size_t, unsigned), std::size_t n) {
+    std::size_t before = counted_bytes;
+    {
+        F f = make(n, 1);
+        std::printf("%-24s %-16s %10zu B    %8.2f B/node\n", name.c_str(), variant, counted_bytes-before, double(counted_bytes-before)/n);
+    }
+}
+
+register_benchmark layout_random("layout/random", [](std::size_t n) {
+    std::string name = "layout/random";
+    {
+        auto f = make_random<forest>(n);
+        bench_traverse(name, "pointer", f, n);
+        bench_traverse(name, "pointer/copy", forest(f), n);
+    }
+    {
+        auto f = make_random<pooled_forest>(n);
+        bench_traverse(name, "pooled", f, n);
+        bench_traverse(name, "pooled/copy", pooled_forest(f), n);
+    }
+    {
+        auto f = make_random<indexed>(n);
+        bench_traverse(name, "indexed", f, n);
+        bench_traverse(name, "indexed/copy", indexed(f), n);
+    }
+    {
+        auto f = make_random<forest>(n);
+        report(name+"/snapshot", "compact_forest", time_ms([&] { compact_forest<int> c(f); }), n);
+        bench_traverse(name, "compact_forest", compact_forest<int>(f), n);
+    }
+
+    using counted_forest = ordered_forest<int, counting_allocator<int>>;
+    using counted_pooled = ordered_forest<int, counting_allocator<int>, forest_node_pool>;
+    using counted_indexed = indexed_forest<int, counting_allocator<int>>;
+
+    report_memory(name+"/bytes", "pointer", make_random<counted_forest>, n);
+    report_memory(name+"/bytes", "pooled", make_random<counted_pooled>, n);
+    report_memory(name+"/bytes", "indexed", make_random<counted_indexed>, n);
+
+    std::size_t before = counted_bytes;
+    {
+        compact_forest<int, counting_allocator<int>> c(make_random<forest>(n));
+        std::printf("%-24s %-16s %10zu B    %8.2f B/node\n", (name+"/bytes").c_str(), "compact_forest", counted_bytes-before, double(counted_bytes-before)/n);
+    }
+});
+
+// Subtree: sum over the subtree of every child of the root, bounded either by
+// an ancestry check at each step or by subtree_end().
+
+template <typename F>
+long long subtree_sums_checked(const F& f) {
+    long long s = 0;
+    for (auto c = f.begin().child(); c; c = c.next()) {
+        for (typename F::const_iterator i = c; i; ++i) {
+            auto a = i;
+            while (a && a!=c) a = a.parent();
+            if (!a) break;
+            s += *i;
+        }
+    }
+    return s;
+}
+
+template <typename F>
+long long subtree_sums_bounded(const F& f) {
+    long long s = 0;
+    for (auto c = f.begin().child(); c; c = c.next()) {
+        for (auto i = f.subtree_begin(c); i!=f.subtree_end(c); ++i) s += *i;
+    }
+    return s;
+}
+
+register_benchmark subtree_random("subtree/random", [](std::size_t n) {
+    auto g = make_random<forest>(n);
+    forest f(g);
+    report("subtree/random", "ancestry check", time_ms([&] { sink = subtree_sums_checked(f); }), n);
+    report("subtree/random", "subtree_end", time_ms([&] { sink = subtree_sums_bounded(f); }), n);
+});
+
+// Depth: sum of node depths, by parent walk or by depth-tracking iteration,
+// and a scan limited to the top levels.
+
+register_benchmark depth_random("depth/random", [](std::size_t n) {
+    auto g = make_random<forest>(n);
+    forest f(g);
+
+    report("depth/random", "parent walk", time_ms([&] {
+        long long s = 0;
+        for (auto i = f.begin(); i!=f.end(); ++i) {
+            for (auto a = i.parent(); a; a = a.parent()) ++s;
+        }
+        sink = s;
+    }), n);
+
+    report("depth/random", "tracked", time_ms([&] {
+        long long s = 0;
+        for (auto i = f.depth_preorder_begin(); i!=f.depth_preorder_end(); ++i) s += i.depth();
+        sink = s;
+    }), n);
+
+    report("depth/random", "max depth 3", time_ms([&] {
+        long long s = 0;
+        for (auto i = f.depth_preorder_begin(3); i!=f.depth_preorder_end(); ++i) s += i.depth();
+        sink = s;
+    }), n);
+});
+
+// Level order: a queue of iterators built per traversal, versus levelorder
+// iteration with a reused frontier.
+
+register_benchmark levelorder_random("levelorder/random", [](std::size_t n) {
+    auto g = make_random<forest>(n);
+    forest f(g);
+
+    report("levelorder/random", "iterator queue", time_ms([&] {
+        long long s = 0;
+        std::deque<forest::const_iterator> q;
+        const forest& cf = f;
+        for (auto r = cf.root_begin(); r!=cf.root_end(); ++r) q.push_back(forest::const_iterator(r));
+        while (!q.empty()) {
+            auto i = q.front();
+            q.pop_front();
+            s += *i;
+            for (auto c = i.child(); c; c = c.next()) q.push_back(forest::const_iterator(c));
+        }
+        sink = s;
+    }), n);
+
+    forest::levelorder_frontier fr;
+    report("levelorder/random", "frontier", time_ms([&] {
+        long long s = 0;
+        for (auto i = f.levelorder_begin(fr); i!=f.levelorder_end(); ++i) s += *i;
+        sink = s;
+    }), n);
+});
+
+// Euler tour: enter and leave actions by a preorder and a postorder pass,
+// versus a single Euler-tour pass.
+
+register_benchmark euler_random("euler/random", [](std::size_t n) {
+    auto f = make_random<forest>(n);
+
+    report("euler/random", "pre+post", time_ms([&] {
+        long long s = 0;
+        for (auto i = f.preorder_begin(); i!=f.preorder_end(); ++i) s += *i;
+        for (auto i = f.postorder_begin(); i!=f.postorder_end(); ++i) s -= *i;
+        sink = s;
+    }), n);
+
+    report("euler/random", "euler", time_ms([&] {
+        long long s = 0;
+        for (auto i = f.euler_begin(); i!=f.euler_end(); ++i) s += i.leaving()? -*i: *i;
+        sink = s;
+    }), n);
+});
+
+// Leaves: summing leaves by filtering a postorder traversal, versus leaf
+// iteration.
+
+register_benchmark leaves_random("leaves/random", [](std::size_t n) {
+    auto f = make_random<forest>(n);
+
+    report("leaves/random", "postorder filter", time_ms([&] {
+        long long s = 0;
+        for (auto i = f.postorder_begin(); i!=f.postorder_end(); ++i) if (!i.child()) s += *i;
+        sink = s;
+    }), n);
+
+    report("leaves/random", "leaf iterator", time_ms([&] {
+        long long s = 0;
+        for (auto i = f.leaf_begin(); i!=f.leaf_end(); ++i) s += *i;
+        sink = s;
+    }), n);
+});
+
+// Fan: erasing a node with n children (which are lifted to its place), and
+// grafting a forest of n trees, with every node recording its parent versus
+// only the last of each list of siblings.
+
+template <typename F>
+void bench_fan(const char* variant, std::size_t n) {
+    F f;
+    auto r = f.push_front(0);
+    auto x = f.push_child(r, 1);
+    for (std::size_t k = 0; k<n; ++k) f.push_child(x, int(k));
+    report("fan/erase", variant, time_ms([&] { f.erase_child(r); }, 1), n);
+
+    F g;
+    for (std::size_t k = 0; k<n; ++k) g.push_front(int(k));
+    report("fan/graft", variant, time_ms([&] { f.graft_after(r.child(), std::move(g)); }, 1), n);
+}
+
+register_benchmark fan("fan", [](std::size_t n) {
+    bench_fan<forest>("eager parent", n);
+    bench_fan<lazy_parent_forest>("lazy parent", n);
+});
+
+// Move: relinking random leaves after random nodes, by prune and graft
+// through a temporary forest versus in place.
+
+template <typename Move>
+double bench_moves(std::size_t n, Move move) {
+    auto f = make_random<linked_forest>(n);
+    std::vector<linked_forest::iterator> nodes;
+    for (auto i = f.begin(); i!=f.end(); ++i) nodes.push_back(i);
+
+    std::minstd_rand R(2);
+    std::uniform_int_distribution<std::size_t> U(0, n-1);
+    std::vector<std::pair<std::size_t, std::size_t>> moves;
+    while (moves.size()<n) {
+        std::size_t a = U(R), b = U(R);
+        if (a!=b && !nodes[a].child() && !nodes[b].child()) moves.push_back({a, b});
+    }
+
+    return time_ms([&] {
+        for (auto& m: moves) move(f, nodes[m.second], nodes[m.first]);
+    }, 1);
+}
+
+register_benchmark move_random("move/random", [](std::size_t n) {
+    report("move/random", "prune+graft", bench_moves(n, [](linked_forest& f, auto dest, auto src) {
+        f.graft_after(dest, f.prune(src));
+    }), n);
+    report("move/random", "move_after", bench_moves(n, [](linked_forest& f, auto dest, auto src) {
+        f.move_after(dest, src);
+    }), n);
+});
+
+// Ranges: removing all but the first and last of the n leaf children of a node
+// at depth 64, one sibling at a time versus as a single run (given its last
+// node). With subtree sizes, each single removal also updates every ancestor.
+
+template <typename F>
+F make_deep_fan(std::size_t n, typename F::iterator& x) {
+    F f;
+    x = f.push_front(0);
+    for (int d = 1; d<64; ++d) x = f.push_child(x, d);
+    for (std::size_t k = 0; k<n; ++k) f.push_child(x, int(k));
+    return f;
+}
+
+// The last child of x but one, which ends the run to remove.
+
+template <typename I>
+I fan_last(I x) {
+    I last = x.child();
+    while (last.next().next()) last = last.next();
+    return last;
+}
+
+template <typename F>
+void bench_ranges(const char* variant, std::size_t n) {
+    typename F::iterator x;
+    F f;
+
+    f = make_deep_fan<F>(n, x);
+    report("range/prune", (variant+std::string(" single")).c_str(), time_ms([&] {
+        auto c = x.child();
+        while (c.next().next()) f.prune_after(c);
+    }, 1), n);
+
+    f = make_deep_fan<F>(n, x);
+    auto last = fan_last(x);
+    report("range/prune", (variant+std::string(" range")).c_str(), time_ms([&] { f.prune_range(x.child(), last); }, 1), n);
+
+    f = make_deep_fan<F>(n, x);
+    report("range/erase", (variant+std::string(" single")).c_str(), time_ms([&] {
+        auto c = x.child();
+        while (c.next().next()) f.erase_after(c);
+    }, 1), n);
+
+    f = make_deep_fan<F>(n, x);
+    last = fan_last(x);
+    report("range/erase", (variant+std::string(" range")).c_str(), time_ms([&] { f.erase_range(x.child(), last); }, 1), n);
+}
+
+register_benchmark range_wide("range/wide", [](std::size_t n) {
+    bench_ranges<forest>("plain", n);
+    bench_ranges<sized_forest>("sized", n);
+});
+
+// Handles: transferring every root of a forest with 1 KB string items to
+// another forest, by copying the item and erasing the node, versus extracting
+// and reinserting the node.
+
+register_benchmark handle_roots("handle/roots", [](std::size_t n) {
+    using string_forest = ordered_forest<std::string>;
+    std::string item(1024, 'x');
+    double copy_ms = 0, handle_ms = 0;
+
+    {
+        string_forest f, g;
+        for (std::size_t k = 0; k<n; ++k) f.push_front(item);
+        copy_ms = time_ms([&] {
+            while (!f.empty()) {
+                g.push_front(f.front());
+                f.erase_front();
+            }
+        }, 1);
+    }
+    {
+        string_forest f, g;
+        for (std::size_t k = 0; k<n; ++k) f.push_front(item);
+        handle_ms = time_ms([&] {
+            while (!f.empty()) g.push_front(f.extract(f.begin()));
+        }, 1);
+    }
+    report("handle/roots", "copy+erase", copy_ms, n);
+    report("handle/roots", "extract", handle_ms, n);
+});
+
+// Threads: preorder traversal of chains of depth sqrt(n), where the step out
+// of each chain climbs the whole chain unless escape links are kept. Reports
+// total time, and the median and slowest of the timed steps out of the chains
+// (including clock overhead; the slowest is prone to scheduling noise).
+
+template <typename F>
+F make_chains(std::size_t n, std::size_t depth) {
+    F f;
+    typename F::iterator i;
+
+    for (std::size_t k = 0; k<n; ++k) {
+        if (k%depth==0) i = f.push_back(int(k));
+        else i = f.push_child(i, int(k));
+    }
+    return f;
+}
+
+template <typename F>
+std::vector<double> leaf_step_ns(const F& f) {
+    using clock = std::chrono::steady_clock;
+    std::vector<double> ns;
+
+    for (auto i = f.preorder_begin(); i!=f.preorder_end(); ) {
+        if (i.child()) {
+            ++i;
+            continue;
+        }
+        auto t0 = clock::now();
+        ++i;
+        ns.push_back(std::chrono::duration<double, std::nano>(clock::now()-t0).count());
+    }
+    std::sort(ns.begin(), ns.end());
+    return ns;
+}
+
+template <typename F>
+void bench_threads(const char* variant, std::size_t n) {
+    std::size_t depth = std::max<std::size_t>(1, std::sqrt(double(n)));
+    F f = make_chains<F>(n, depth);
+
+    report("thread/chains/pre", variant, time_ms([&] { sink = preorder_sum(f); }), n);
+    auto ns = leaf_step_ns(f);
+    std::printf("%-24s %-16s %10.0f ns median %8.0f ns max (depth %zu)\n", "thread/chains/escape", variant, ns[ns.size()/2], ns.back(), depth);
+}
+
+register_benchmark thread_chains("thread/chains", [](std::size_t n) {
+    bench_threads<forest>("parent climb", n);
+    bench_threads<threaded_forest>("threaded", n);
+});
+
+// Prefetch: cold traversal of a randomly built forest, whose preorder
+// sequence is scattered through memory, with plain and prefetching iterators
+// at several distances. Caches are flushed before each run. (The requested
+// 100M-node comparison is run with -n 100000000, given about 4 GB of memory.)
+
+void flush_caches() {
+    static std::vector<char> junk(std::size_t(64)<<20);
+    for (std::size_t k = 0; k<junk.size(); k += 64) junk[k] += 1;
+}
+
+template <typename Fn>
+double cold_time_ms(Fn&& f, int reps = 5) {
+    double best = 0;
+    for (int r = 0; r<reps; ++r) {
+        flush_caches();
+        double ms = time_ms(f, 1);
+        if (!r || ms<best) best = ms;
+    }
+    return best;
+}
+
+register_benchmark prefetch_random("prefetch/random", [](std::size_t n) {
+    auto f = make_random<forest>(n);
+    const forest& cf = f;
+    char variant[32];
+
+    report("prefetch/random/pre", "plain", cold_time_ms([&] { sink = preorder_sum(cf); }), n);
+    for (std::size_t d: {8, 64, 256}) {
+        std::snprintf(variant, sizeof variant, "distance %zu", d);
+        forest::prefetch_window w(d);
+        report("prefetch/random/pre", variant, cold_time_ms([&] {
+            long long s = 0;
+            for (auto i = cf.prefetch_preorder_begin(w); i!=cf.prefetch_preorder_end(); ++i) s += *i;
+            sink = s;
+        }), n);
+    }
+
+    report("prefetch/random/post", "plain", cold_time_ms([&] { sink = postorder_sum(cf); }), n);
+    for (std::size_t d: {8, 64, 256}) {
+        std::snprintf(variant, sizeof variant, "distance %zu", d);
+        forest::prefetch_window w(d);
+        report("prefetch/random/post", variant, cold_time_ms([&] {
+            long long s = 0;
+            for (auto i = cf.prefetch_postorder_begin(w); i!=cf.prefetch_postorder_end(); ++i) s += *i;
+            sink = s;
+        }), n);
+    }
+});
+
+// Bulk: building a random forest from its preorder depth and parent index
+// arrays, through insert_after() and push_child() versus the factories.
+
+template <typename F>
+F build_by_insertion(const std::vector<int>& values, const std::vector<std::size_t>& depths) {
+    F f;
+    std::vector<typename F::iterator> spine;
+    for (std::size_t k = 0; k<values.size(); ++k) {
+        std::size_t d = depths[k];
+        if (d<spine.size()) {
+            spine.resize(d+1);
+            spine[d] = f.insert_after(spine[d], values[k]);
+        }
+        else {
+            spine.push_back(d? f.push_child(spine[d-1], values[k]): f.push_front(values[k]));
+        }
+    }
+    return f;
+}
+
+template <typename F>
+void bench_bulk(const char* variant, std::size_t n) {
+    auto g = make_random<F>(n);
+    std::vector<int> values(g.begin(), g.end());
+    auto depths = g.preorder_depths();
+    auto parents = g.parent_indices();
+
+    report("bulk/random", (variant+std::string(" insert")).c_str(), time_ms([&] { F f = build_by_insertion<F>(values, depths); }), n);
+    report("bulk/random", (variant+std::string(" depths")).c_str(), time_ms([&] { F f = F::from_preorder_depths(values, depths); }), n);
+    report("bulk/random", (variant+std::string(" parents")).c_str(), time_ms([&] { F f = F::from_parent_indices(values, parents); }), n);
+}
+
+register_benchmark bulk_random("bulk/random", [](std::size_t n) {
+    bench_bulk<forest>("plain", n);
+    bench_bulk<pooled_forest>("pooled", n);
+    bench_bulk<sized_forest>("sized", n);
+});
+
+// Compact: traversal of a randomly built forest before and after compact().
+
+template <typename F>
+void bench_compact(const std::string& name, std::size_t n) {
+    F f = make_random<F>(n);
+    bench_traverse(name, "scattered", f, n);
+    report(name, "compact", time_ms([&] { f.compact(); }, 1), n);
+    bench_traverse(name, "compacted", f, n);
+}
+
+register_benchmark compact_random("compact/random", [](std::size_t n) { bench_compact<forest>("compact/random", n); });
+register_benchmark compact_random_pooled("compact/random/pooled", [](std::size_t n) {
+    bench_compact<pooled_forest>("compact/random/pooled", n);
+});
+
+int main(int argc, char** argv) {
+    std::size_t n = 1000000;
+    std::vector<std::string> prefixes;
+
+    for (int i = 1; i<argc; ++i) {
+        if (!std::strcmp(argv[i], "-n") && i+1<argc) n = std::strtoull(argv[++i], nullptr, 10);
+        else prefixes.push_back(argv[i]);
+    }
+
+    for (auto& b: registry()) {
+        bool selected = prefixes.empty() ||
+            std::any_of(prefixes.begin(), prefixes.end(), [&](auto& p) { return b.name.compare(0, p.size(), p)==0; });
+        if (selected) b.run(n);
+    }
+}
@@ -0,0 +1,489 @@
+#ifndef COMPACT_FOREST_H_
+#define COMPACT_FOREST_H_
+
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#include "ordered_forest.h"
+
+// Frozen snapshot of an ordered_forest in structure-of-arrays form, for forests
+// that are built once and traversed many times.
+//
+// Items are held in a single array in preorder, alongside parallel arrays of
+// the parent index, the index one past the end of the subtree, and the depth of
+// each node. Preorder iteration is a linear scan, skipping a subtree is a
+// single index jump, and subtree size and depth are O(1).
+//
+// Items may be modified through mutable iterators; the structure is fixed at
+// construction.
+
+template <typename V, typename Allocator = std::allocator<V>, typename Index = std::uint32_t>
+struct compact_forest {
+    static_assert(std::is_unsigned<Index>::value, "Index must be an unsigned integer type");
+
+private:
+    static constexpr Index npos = std::numeric_limits<Index>::max();
+
+    using index_alloc_t = typename std::allocator_traits<Allocator>::template rebind_alloc<Index>;
+    using index_vector = std::vector<Index, index_alloc_t>;
+
+public:
+    using value_type = V;
+    using allocator_type = Allocator;
+    using size_type = std::size_t;
+    using index_type = Index;
+
+    // Iterators hold a pointer to the forest and a preorder index.
+
+    template <bool const_flag>
+    struct iterator_mc {
+        using pointer = std::conditional_t<const_flag, const V*, V*>;
+        using reference = std::conditional_t<const_flag, const V&, V&>;
+        using value_type = V;
+        using difference_type = std::ptrdiff_t;
+        using iterator_category = std::forward_iterator_tag;
+
+        iterator_mc() = default;
+
+        template <bool flag = const_flag, typename std::enable_if_t<flag, int> = 0>
+        iterator_mc(const iterator_mc<false>& i): f_(i.f_), i_(i.i_) {}
+
+        explicit operator bool() const { return i_!=npos; }
+
+        iterator_mc parent() const { return at(i_!=npos? f_->parent_[i_]: npos); }
+
+        iterator_mc next() const {
+            if (i_==npos) return {};
+            Index e = f_->end_[i_];
+            return at(e<f_->size() && f_->parent_[e]==f_->parent_[i_]? e: npos);
+        }
+
+        iterator_mc child() const {
+            return at(i_!=npos && f_->end_[i_]>i_+1? i_+1: npos);
+        }
+
+        // Depth of the node: zero for roots.
+        size_type depth() const { return f_->depth_[i_]; }
+
+        // Position of the node in preorder.
+        size_type index() const { return i_; }
+
+        template <bool flag>
+        bool operator==(const iterator_mc<flag>& a) const { return i_ == a.i_; }
+
+        template <bool flag>
+        bool operator!=(const iterator_mc<flag>& a) const { return i_ != a.i_; }
+
+        iterator_mc preorder_next() const {
+            return at(i_!=npos && i_+1<f_->size()? i_+1: npos);
+        }
+
+        // The node following the subtree of this node in preorder.
+        iterator_mc preorder_skip() const {
+            return at(i_!=npos && f_->end_[i_]<f_->size()? f_->end_[i_]: npos);
+        }
+
+        iterator_mc postorder_next() const {
+            if (i_==npos) return {};
+            if (iterator_mc n = next()) {
+                while (iterator_mc c = n.child()) n = c;
+                return n;
+            }
+            else return parent();
+        }
+
+        reference operator*() const { return f_->items_[i_]; }
+        pointer operator->() const { return &f_->items_[i_]; }
+
+    protected:
+        friend compact_forest;
+        template <bool> friend struct iterator_mc;
+
+        using forest_ptr = std::conditional_t<const_flag, const compact_forest*, compact_forest*>;
+
+        forest_ptr f_ = nullptr;
+        Index i_ = npos;
+
+        iterator_mc(forest_ptr f, Index i): f_(f), i_(i) {}
+
+        iterator_mc at(Index j) const { return j==npos? iterator_mc{}: iterator_mc(f_, j); }
+    };
+
+    template <bool const_flag>
+    struct sibling_iterator_mc: iterator_mc<const_flag> {
+        sibling_iterator_mc() = default;
+        sibling_iterator_mc(const iterator_mc<const_flag>& i): iterator_mc<const_flag>(i) {}
+
+        sibling_iterator_mc& operator++() { return *this = this->next(); }
+        sibling_iterator_mc operator++(int) { auto p = *this; return ++*this, p; }
+    };
+
+    using sibling_iterator = sibling_iterator_mc<false>;
+    using const_sibling_iterator = sibling_iterator_mc<true>;
+
+    template <bool const_flag>
+    struct preorder_iterator_mc: iterator_mc<const_flag> {
+        preorder_iterator_mc() = default;
+        preorder_iterator_mc(const iterator_mc<const_flag>& i): iterator_mc<const_flag>(i) {}
+
+        preorder_iterator_mc& operator++() { return *this = this->preorder_next(); }
+        preorder_iterator_mc operator++(int) { auto p = *this; return ++*this, p; }
+
+        // Advance past the subtree of the current node.
+        preorder_iterator_mc& skip_subtree() { return *this = this->preorder_skip(); }
+    };
+
+    using preorder_iterator = preorder_iterator_mc<false>;
+    using const_preorder_iterator = preorder_iterator_mc<true>;
+
+    template <bool const_flag>
+    struct postorder_iterator_mc: iterator_mc<const_flag> {
+        postorder_iterator_mc() = default;
+        postorder_iterator_mc(const iterator_mc<const_flag>& i): iterator_mc<const_flag>(i) {}
+
+        postorder_iterator_mc& operator++() { return *this = this->postorder_next(); }
+        postorder_iterator_mc operator++(int) { auto p = *this; return ++*this, p; }
+    };
+
+    using postorder_iterator = postorder_iterator_mc<false>;
+    using const_postorder_iterator = postorder_iterator_mc<true>;
+
+    // Depth-limited iterators: nodes at max_depth are treated as leaves. As for
+    // ordered_forest, depths are relative to the starting node, which is taken
+    // to be at the given depth; as depth is stored, they need no tracking, but
+    // are offset from the stored depth.
+
+    static constexpr size_type no_depth_limit = size_type(-1);
+
+    template <bool const_flag>
+    struct depth_preorder_iterator_mc: iterator_mc<const_flag> {
+        depth_preorder_iterator_mc() = default;
+        explicit depth_preorder_iterator_mc(const iterator_mc<const_flag>& i, size_type depth = 0, size_type max_depth = no_depth_limit):
+            iterator_mc<const_flag>(i), offset_(i? depth-i.depth(): depth), max_depth_(max_depth) {}
+
+        size_type depth() const { return iterator_mc<const_flag>::depth()+offset_; }
+        size_type max_depth() const { return max_depth_; }
+
+        depth_preorder_iterator_mc& operator++() {
+            if (this->i_!=npos && depth()>=max_depth_) return skip_subtree();
+            static_cast<iterator_mc<const_flag>&>(*this) = this->preorder_next();
+            return *this;
+        }
+
+        depth_preorder_iterator_mc operator++(int) { auto p = *this; return ++*this, p; }
+
+        // Advance past the subtree of the current node.
+        depth_preorder_iterator_mc& skip_subtree() {
+            static_cast<iterator_mc<const_flag>&>(*this) = this->preorder_skip();
+            return *this;
+        }
+
+    private:
+        size_type offset_ = 0;
+        size_type max_depth_ = no_depth_limit;
+    };
+
+    using depth_preorder_iterator = depth_preorder_iterator_mc<false>;
+    using const_depth_preorder_iterator = depth_preorder_iterator_mc<true>;
+
+    template <bool const_flag>
+    struct depth_postorder_iterator_mc: iterator_mc<const_flag> {
+        depth_postorder_iterator_mc() = default;
+
+        // Start at the first node in postorder of the (depth-limited) tree at i.
+        explicit depth_postorder_iterator_mc(const iterator_mc<const_flag>& i, size_type depth = 0, size_type max_depth = no_depth_limit):
+            iterator_mc<const_flag>(i), offset_(i? depth-i.depth(): depth), max_depth_(max_depth)
+        {
+            descend();
+        }
+
+        size_type depth() const { return iterator_mc<const_flag>::depth()+offset_; }
+        size_type max_depth() const { return max_depth_; }
+
+        depth_postorder_iterator_mc& operator++() {
+            if (this->i_==npos) return *this;
+            if (auto n = this->next()) {
+                static_cast<iterator_mc<const_flag>&>(*this) = n;
+                descend();
+            }
+            else {
+                static_cast<iterator_mc<const_flag>&>(*this) = this->parent();
+            }
+            return *this;
+        }
+
+        depth_postorder_iterator_mc operator++(int) { auto p = *this; return ++*this, p; }
+
+    private:
+        size_type offset_ = 0;
+        size_type max_depth_ = no_depth_limit;
+
+        void descend() {
+            if (this->i_==npos) return;
+            while (depth()<max_depth_ && this->child()) ++this->i_;
+        }
+    };
+
+    using depth_postorder_iterator = depth_postorder_iterator_mc<false>;
+    using const_depth_postorder_iterator = depth_postorder_iterator_mc<true>;
+
+    bool empty() const { return items_.empty(); }
+    size_type size() const { return items_.size(); }
+
+    // Order statistics, all O(1).
+
+    size_type subtree_size(const iterator_mc<true>& i) const { return end_[i.i_]-i.i_; }
+    size_type preorder_rank(const iterator_mc<true>& i) const { return i.i_; }
+
+    preorder_iterator nth_preorder(size_type k) { return preorder_iterator{iter(k<size()? Index(k): npos)}; }
+    const_preorder_iterator nth_preorder(size_type k) const { return const_preorder_iterator{iter(k<size()? Index(k): npos)}; }
+
+    sibling_iterator child_begin(const iterator_mc<false>& i) { return sibling_iterator{i.child()}; }
+    const_sibling_iterator child_begin(const iterator_mc<true>& i) const { return const_sibling_iterator{i.child()}; }
+
+    sibling_iterator child_end(const iterator_mc<true>&) { return {}; }
+    const_sibling_iterator child_end(const iterator_mc<true>&) const { return {}; }
+
+    sibling_iterator root_begin() { return sibling_iterator{first()}; }
+    const_sibling_iterator root_begin() const { return const_sibling_iterator{first()}; }
+
+    sibling_iterator root_end() { return {}; }
+    const_sibling_iterator root_end() const { return {}; }
+
+    postorder_iterator postorder_begin() { return postorder_iterator{first_leaf()}; }
+    const_postorder_iterator postorder_begin() const { return const_postorder_iterator{first_leaf()}; }
+
+    postorder_iterator postorder_end() { return {}; }
+    const_postorder_iterator postorder_end() const { return {}; }
+
+    preorder_iterator preorder_begin() { return preorder_iterator{first()}; }
+    const_preorder_iterator preorder_begin() const { return const_preorder_iterator{first()}; }
+
+    preorder_iterator preorder_end() { return {}; }
+    const_preorder_iterator preorder_end() const { return {}; }
+
+    // Default iteration is preorder.
+
+    using iterator = preorder_iterator;
+    using const_iterator = const_preorder_iterator;
+
+    iterator begin() { return preorder_begin(); }
+    iterator end() { return {}; }
+
+    const_iterator begin() const { return preorder_begin(); }
+    const_iterator end() const { return {}; }
+
+    const_iterator cbegin() const { return preorder_begin(); }
+    const_iterator cend() const { return {}; }
+
+    // Depth-limited iteration over the whole forest.
+
+    depth_preorder_iterator depth_preorder_begin(size_type max_depth = no_depth_limit) { return depth_preorder_iterator{first(), 0, max_depth}; }
+    const_depth_preorder_iterator depth_preorder_begin(size_type max_depth = no_depth_limit) const { return const_depth_preorder_iterator{first(), 0, max_depth}; }
+
+    depth_preorder_iterator depth_preorder_end() { return {}; }
+    const_depth_preorder_iterator depth_preorder_end() const { return {}; }
+
+    depth_postorder_iterator depth_postorder_begin(size_type max_depth = no_depth_limit) { return depth_postorder_iterator{first(), 0, max_depth}; }
+    const_depth_postorder_iterator depth_postorder_begin(size_type max_depth = no_depth_limit) const { return const_depth_postorder_iterator{first(), 0, max_depth}; }
+
+    depth_postorder_iterator depth_postorder_end() { return {}; }
+    const_depth_postorder_iterator depth_postorder_end() const { return {}; }
+
+    // Iteration over the subtree rooted at i, in preorder or postorder. The end
+    // iterator is the node that follows the subtree.
+
+    preorder_iterator subtree_begin(const iterator_mc<false>& i) { return preorder_iterator{i}; }
+    const_preorder_iterator subtree_begin(const iterator_mc<true>& i) const { return const_preorder_iterator{i}; }
+
+    preorder_iterator subtree_end(const iterator_mc<false>& i) { return preorder_iterator{i.preorder_skip()}; }
+    const_preorder_iterator subtree_end(const iterator_mc<true>& i) const { return const_preorder_iterator{i.preorder_skip()}; }
+
+    postorder_iterator subtree_postorder_begin(const iterator_mc<false>& i) { return postorder_iterator{first_leaf_below(i)}; }
+    const_postorder_iterator subtree_postorder_begin(const iterator_mc<true>& i) const { return const_postorder_iterator{first_leaf_below(i)}; }
+
+    postorder_iterator subtree_postorder_end(const iterator_mc<false>& i) { return postorder_iterator{i.postorder_next()}; }
+    const_postorder_iterator subtree_postorder_end(const iterator_mc<true>& i) const { return const_postorder_iterator{i.postorder_next()}; }
+
+    // Preorder visit of the whole forest, or of the subtree rooted at i. The
+    // visitor is called with a preorder iterator to each node, and returns
+    // forest_descend to continue, forest_prune to skip the node's descendants,
+    // or forest_stop to finish. Returns an iterator to the node at which the
+    // visit stopped, or the end of the range.
+
+    template <typename Visitor>
+    iterator visit(Visitor&& visitor) { return visit_impl(begin(), end(), visitor); }
+
+    template <typename Visitor>
+    const_iterator visit(Visitor&& visitor) const { return visit_impl(begin(), end(), visitor); }
+
+    template <typename Visitor>
+    iterator visit(const iterator_mc<false>& i, Visitor&& visitor) { return visit_impl(subtree_begin(i), subtree_end(i), visitor); }
+
+    template <typename Visitor>
+    const_iterator visit(const iterator_mc<true>& i, Visitor&& visitor) const { return visit_impl(subtree_begin(i), subtree_end(i), visitor); }
+
+    // Items in preorder.
+
+    V* data() { return items_.data(); }
+    const V* data() const { return items_.data(); }
+
+    // Comparison: equal structure and items.
+
+    bool operator==(const compact_forest& other) const {
+        return items_==other.items_ && parent_==other.parent_;
+    }
+
+    bool operator!=(const compact_forest& other) const {
+        return !(*this==other);
+    }
+
+    // Construction from an ordered_forest, in one preorder pass.
+
+    explicit compact_forest(const Allocator& alloc = Allocator()):
+        items_(alloc),
+        parent_(index_alloc_t(alloc)),
+        end_(index_alloc_t(alloc)),
+        depth_(index_alloc_t(alloc))
+    {}
+
+    template <typename OtherAllocator, unsigned Features>
+    explicit compact_forest(const ordered_forest<V, OtherAllocator, Features>& f, const Allocator& alloc = Allocator()):
+        compact_forest(alloc)
+    {
+        if (f.size()>=npos) throw std::length_error("compact_forest: too many nodes");
+
+        size_type n = f.size();
+        items_.reserve(n);
+        parent_.reserve(n);
+        end_.reserve(n);
+        depth_.reserve(n);
+
+        Index parent = npos;
+        Index depth = 0;
+
+        for (auto i = f.root_begin(); i; ) {
+            Index x = Index(items_.size());
+            items_.push_back(*i);
+            parent_.push_back(parent);
+            end_.push_back(x+1);
+            depth_.push_back(depth);
+
+            if (i.child()) {
+                i = i.child();
+                parent = x;
+                ++depth;
+                continue;
+            }
+
+            while (i && !i.next()) {
+                i = i.parent();
+                if (parent!=npos) {
+                    end_[parent] = Index(items_.size());
+                    parent = parent_[parent];
+                    --depth;
+                }
+            }
+            if (i) i = i.next();
+        }
+    }
+
+    compact_forest(const compact_forest&) = default;
+    compact_forest(compact_forest&&) = default;
+    compact_forest& operator=(const compact_forest&) = default;
+    compact_forest& operator=(compact_forest&&) = default;
+
+    // Reconstruct an ordered_forest with the same structure and items.
+
+    template <typename F = ordered_forest<V, Allocator>>
+    F to_forest() const {
+        using sibling_iterator = typename F::sibling_iterator;
+
+        F f;
+        std::vector<sibling_iterator> nodes(size());
+        std::vector<sibling_iterator> last_child(size());
+        sibling_iterator last_root;
+
+        for (Index x = 0; x<size(); ++x) {
+            Index p = parent_[x];
+            sibling_iterator& prev = p==npos? last_root: last_child[p];
+
+            if (prev) prev = f.insert_after(prev, items_[x]);
+            else if (p==npos) prev = f.push_front(items_[x]);
+            else prev = f.push_child(nodes[p], items_[x]);
+            nodes[x] = prev;
+        }
+        return f;
+    }
+
+    void swap(compact_forest& other) {
+        using std::swap;
+        swap(items_, other.items_);
+        swap(parent_, other.parent_);
+        swap(end_, other.end_);
+        swap(depth_, other.depth_);
+    }
+
+    friend void swap(compact_forest& a, compact_forest& b) {
+        a.swap(b);
+    }
+
+    allocator_type get_allocator() const noexcept { return items_.get_allocator(); }
+
+private:
+    std::vector<V, Allocator> items_;
+    index_vector parent_;
+    index_vector end_;
+    index_vector depth_;
+
+    iterator_mc<false> iter(Index i) { return i==npos? iterator_mc<false>{}: iterator_mc<false>(this, i); }
+    iterator_mc<true> iter(Index i) const { return i==npos? iterator_mc<true>{}: iterator_mc<true>(this, i); }
+
+    iterator_mc<false> first() { return iter(empty()? npos: 0); }
+    iterator_mc<true> first() const { return iter(empty()? npos: 0); }
+
+    template <typename Iter, typename Visitor>
+    static Iter visit_impl(Iter i, Iter end, Visitor& visitor) {
+        while (i!=end) {
+            switch (visitor(static_cast<const Iter&>(i))) {
+            case forest_stop:
+                return i;
+            case forest_prune:
+                i.skip_subtree();
+                break;
+            default:
+                ++i;
+            }
+        }
+        return i;
+    }
+
+    template <bool flag>
+    static iterator_mc<flag> first_leaf_below(iterator_mc<flag> i) {
+        while (auto c = i.child()) i = c;
+        return i;
+    }
+
+    Index first_leaf_index() const {
+        if (empty()) return npos;
+        Index x = 0;
+        while (end_[x]>x+1) ++x;
+        return x;
+    }
+
+    iterator_mc<false> first_leaf() { return iter(first_leaf_index()); }
+    iterator_mc<true> first_leaf() const { return iter(first_leaf_index()); }
+};
+
+template <typename V, typename Allocator, typename Index>
+constexpr Index compact_forest<V, Allocator, Index>::npos;
+
+template <typename V, typename Allocator, typename Index>
+constexpr typename compact_forest<V, Allocator, Index>::size_type compact_forest<V, Allocator, Index>::no_depth_limit;
+
+#endif // ndef COMPACT_FOREST_H_
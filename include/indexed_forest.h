@@ -0,0 +1,1023 @@
+#ifndef INDEXED_FOREST_H_
+#define INDEXED_FOREST_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <initializer_list>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#include "ordered_forest.h"
+
+// Multiway ordered forest with the iteration and editing interface of
+// ordered_forest, but with nodes held in a single contiguous array and linked
+// by indices of type Index rather than by pointers. With 32-bit indices, the
+// links of a node occupy 12 bytes instead of 24.
+//
+// Differences from ordered_forest:
+//
+// * Insertion may reallocate the node array, moving items. Iterators remain
+//   valid, as they refer to nodes by index through the forest, but pointers
+//   and references to items do not. Moving or swapping forests invalidates
+//   their iterators.
+//
+// * Prune and graft move items between node arrays, and so are linear in the
+//   number of nodes moved. Items are moved with std::move_if_noexcept.
+//
+// * A forest holds at most max_size() nodes, one fewer than the largest
+//   representable index.
+
+template <typename V, typename Allocator = std::allocator<V>, typename Index = std::uint32_t>
+struct indexed_forest {
+    static_assert(std::is_unsigned<Index>::value, "Index must be an unsigned integer type");
+
+private:
+    static constexpr Index npos = std::numeric_limits<Index>::max();
+
+    // Parent index of a free slot.
+    static constexpr Index dead = npos-1;
+
+    struct node {
+        Index parent_ = npos;
+        Index child_ = npos;
+        Index next_ = npos;
+        std::aligned_storage_t<sizeof(V), alignof(V)> item_;
+
+        V* item() { return reinterpret_cast<V*>(&item_); }
+    };
+
+    using node_alloc_t = typename std::allocator_traits<Allocator>::template rebind_alloc<node>;
+    using item_alloc_traits = std::allocator_traits<Allocator>;
+    using node_alloc_traits = std::allocator_traits<node_alloc_t>;
+
+public:
+    using value_type = V;
+    using allocator_type = Allocator;
+    using size_type = std::size_t;
+    using index_type = Index;
+
+    // Iterators hold a pointer to the forest's node array pointer, and an index.
+    // Constructor overloads permit construction of any const iterator from any
+    // other iterator, or of any mutable iterator from any other mutable iterator.
+
+    template <bool const_flag>
+    struct iterator_mc {
+        using pointer = std::conditional_t<const_flag, const V*, V*>;
+        using reference = std::conditional_t<const_flag, const V&, V&>;
+        using value_type = V;
+        using difference_type = std::ptrdiff_t;
+        using iterator_category = std::forward_iterator_tag;
+
+        iterator_mc() = default;
+
+        template <bool flag = const_flag, typename std::enable_if_t<flag, int> = 0>
+        iterator_mc(const iterator_mc<false>& i): base_(i.base_), i_(i.i_) {}
+
+        explicit operator bool() const { return i_!=npos; }
+
+        iterator_mc parent() const { return at(i_!=npos? n().parent_: npos); }
+        iterator_mc next() const { return at(i_!=npos? n().next_: npos); }
+        iterator_mc child() const { return at(i_!=npos? n().child_: npos); }
+
+        template <bool flag>
+        bool operator==(const iterator_mc<flag>& a) const { return i_ == a.i_; }
+
+        template <bool flag>
+        bool operator!=(const iterator_mc<flag>& a) const { return i_ != a.i_; }
+
+        iterator_mc preorder_next() const {
+            if (i_!=npos && n().child_!=npos) return at(n().child_);
+            return preorder_skip();
+        }
+
+        // The first node following the subtree of this node in preorder.
+        iterator_mc preorder_skip() const {
+            if (i_==npos) return {};
+            node* ns = *base_;
+
+            Index x = i_;
+            while (x!=npos && ns[x].next_==npos) x = ns[x].parent_;
+            return at(x!=npos? ns[x].next_: npos);
+        }
+
+        iterator_mc postorder_next() const {
+            if (i_==npos) return {};
+            node* ns = *base_;
+            if (ns[i_].next_!=npos) {
+                Index x = ns[i_].next_;
+                while (ns[x].child_!=npos) x = ns[x].child_;
+                return at(x);
+            }
+            else return parent();
+        }
+
+        reference operator*() const { return *n().item(); }
+        pointer operator->() const { return n().item(); }
+
+    protected:
+        friend indexed_forest;
+        template <bool> friend struct iterator_mc;
+
+        node* const* base_ = nullptr;
+        Index i_ = npos;
+
+        iterator_mc(node* const* base, Index i): base_(base), i_(i) {}
+
+        node& n() const { return (*base_)[i_]; }
+        iterator_mc at(Index j) const { return j==npos? iterator_mc{}: iterator_mc(base_, j); }
+    };
+
+    template <bool const_flag>
+    struct sibling_iterator_mc: iterator_mc<const_flag> {
+        sibling_iterator_mc() = default;
+        sibling_iterator_mc(const iterator_mc<const_flag>& i): iterator_mc<const_flag>(i) {}
+
+        sibling_iterator_mc& operator++() { return *this = this->next(); }
+        sibling_iterator_mc operator++(int) { auto p = *this; return ++*this, p; }
+    };
+
+    using sibling_iterator = sibling_iterator_mc<false>;
+    using const_sibling_iterator = sibling_iterator_mc<true>;
+
+    template <bool const_flag>
+    struct preorder_iterator_mc: iterator_mc<const_flag> {
+        preorder_iterator_mc() = default;
+        preorder_iterator_mc(const iterator_mc<const_flag>& i): iterator_mc<const_flag>(i) {}
+
+        preorder_iterator_mc& operator++() { return *this = this->preorder_next(); }
+        preorder_iterator_mc operator++(int) { auto p = *this; return ++*this, p; }
+
+        // Advance past the subtree of the current node.
+        preorder_iterator_mc& skip_subtree() { return *this = this->preorder_skip(); }
+    };
+
+    using preorder_iterator = preorder_iterator_mc<false>;
+    using const_preorder_iterator = preorder_iterator_mc<true>;
+
+    template <bool const_flag>
+    struct postorder_iterator_mc: iterator_mc<const_flag> {
+        postorder_iterator_mc() = default;
+        postorder_iterator_mc(const iterator_mc<const_flag>& i): iterator_mc<const_flag>(i) {}
+
+        postorder_iterator_mc& operator++() { return *this = this->postorder_next(); }
+        postorder_iterator_mc operator++(int) { auto p = *this; return ++*this, p; }
+    };
+
+    using postorder_iterator = postorder_iterator_mc<false>;
+    using const_postorder_iterator = postorder_iterator_mc<true>;
+
+    // Depth-tracking iterators, as for ordered_forest.
+
+    static constexpr size_type no_depth_limit = size_type(-1);
+
+    template <bool const_flag>
+    struct depth_preorder_iterator_mc: iterator_mc<const_flag> {
+        depth_preorder_iterator_mc() = default;
+        explicit depth_preorder_iterator_mc(const iterator_mc<const_flag>& i, size_type depth = 0, size_type max_depth = no_depth_limit):
+            iterator_mc<const_flag>(i), depth_(depth), max_depth_(max_depth) {}
+
+        size_type depth() const { return depth_; }
+        size_type max_depth() const { return max_depth_; }
+
+        depth_preorder_iterator_mc& operator++() {
+            if (this->i_!=npos && this->n().child_!=npos && depth_<max_depth_) {
+                this->i_ = this->n().child_;
+                ++depth_;
+                return *this;
+            }
+            return skip_subtree();
+        }
+
+        depth_preorder_iterator_mc operator++(int) { auto p = *this; return ++*this, p; }
+
+        // Advance past the subtree of the current node.
+        depth_preorder_iterator_mc& skip_subtree() {
+            if (this->i_==npos) return *this;
+            node* ns = *this->base_;
+
+            Index x = this->i_;
+            while (x!=npos && ns[x].next_==npos) {
+                x = ns[x].parent_;
+                --depth_;
+            }
+            this->i_ = x!=npos? ns[x].next_: npos;
+            return *this;
+        }
+
+    private:
+        size_type depth_ = 0;
+        size_type max_depth_ = no_depth_limit;
+    };
+
+    using depth_preorder_iterator = depth_preorder_iterator_mc<false>;
+    using const_depth_preorder_iterator = depth_preorder_iterator_mc<true>;
+
+    template <bool const_flag>
+    struct depth_postorder_iterator_mc: iterator_mc<const_flag> {
+        depth_postorder_iterator_mc() = default;
+
+        // Start at the first node in postorder of the (depth-limited) tree at i.
+        explicit depth_postorder_iterator_mc(const iterator_mc<const_flag>& i, size_type depth = 0, size_type max_depth = no_depth_limit):
+            iterator_mc<const_flag>(i), depth_(depth), max_depth_(max_depth)
+        {
+            descend();
+        }
+
+        size_type depth() const { return depth_; }
+        size_type max_depth() const { return max_depth_; }
+
+        depth_postorder_iterator_mc& operator++() {
+            if (this->i_==npos) return *this;
+            if (this->n().next_!=npos) {
+                this->i_ = this->n().next_;
+                descend();
+            }
+            else {
+                this->i_ = this->n().parent_;
+                --depth_;
+            }
+            return *this;
+        }
+
+        depth_postorder_iterator_mc operator++(int) { auto p = *this; return ++*this, p; }
+
+    private:
+        size_type depth_ = 0;
+        size_type max_depth_ = no_depth_limit;
+
+        void descend() {
+            if (this->i_==npos) return;
+            while (this->n().child_!=npos && depth_<max_depth_) {
+                this->i_ = this->n().child_;
+                ++depth_;
+            }
+        }
+    };
+
+    using depth_postorder_iterator = depth_postorder_iterator_mc<false>;
+    using const_depth_postorder_iterator = depth_postorder_iterator_mc<true>;
+
+    bool empty() const { return first_==npos; }
+    size_type size() const { return size_; }
+
+    size_type capacity() const { return capacity_; }
+    static constexpr size_type max_size() { return size_type(dead); }
+
+    // Ensure the node array can hold n nodes without reallocation.
+
+    void reserve(size_type n) {
+        if (n>max_size()) throw std::length_error("indexed_forest: too many nodes");
+        if (n>capacity_) relocate(n, [](node*) { return false; });
+    }
+
+    sibling_iterator child_begin(const iterator_mc<false>& i) { return sibling_iterator{i.child()}; }
+    const_sibling_iterator child_begin(const iterator_mc<true>& i) const { return const_sibling_iterator{i.child()}; }
+
+    sibling_iterator child_end(const iterator_mc<true>&) { return {}; }
+    const_sibling_iterator child_end(const iterator_mc<true>&) const { return {}; }
+
+    sibling_iterator root_begin() { return sibling_iterator{iter(first_)}; }
+    const_sibling_iterator root_begin() const { return const_sibling_iterator{iter(first_)}; }
+
+    sibling_iterator root_end() { return {}; }
+    const_sibling_iterator root_end() const { return {}; }
+
+    postorder_iterator postorder_begin() { return postorder_iterator{iter(first_leaf())}; }
+    const_postorder_iterator postorder_begin() const { return const_postorder_iterator{iter(first_leaf())}; }
+
+    postorder_iterator postorder_end() { return {}; }
+    const_postorder_iterator postorder_end() const { return {}; }
+
+    preorder_iterator preorder_begin() { return preorder_iterator{iter(first_)}; }
+    const_preorder_iterator preorder_begin() const { return const_preorder_iterator{iter(first_)}; }
+
+    preorder_iterator preorder_end() { return {}; }
+    const_preorder_iterator preorder_end() const { return {}; }
+
+    // Default iteration is preorder.
+
+    using iterator = preorder_iterator;
+    using const_iterator = const_preorder_iterator;
+
+    iterator begin() { return preorder_begin(); }
+    iterator end() { return {}; }
+
+    const_iterator begin() const { return preorder_begin(); }
+    const_iterator end() const { return {}; }
+
+    const_iterator cbegin() const { return preorder_begin(); }
+    const_iterator cend() const { return {}; }
+
+    // Depth-tracking iteration over the whole forest, to at most max_depth.
+
+    depth_preorder_iterator depth_preorder_begin(size_type max_depth = no_depth_limit) { return depth_preorder_iterator{iter(first_), 0, max_depth}; }
+    const_depth_preorder_iterator depth_preorder_begin(size_type max_depth = no_depth_limit) const { return const_depth_preorder_iterator{iter(first_), 0, max_depth}; }
+
+    depth_preorder_iterator depth_preorder_end() { return {}; }
+    const_depth_preorder_iterator depth_preorder_end() const { return {}; }
+
+    depth_postorder_iterator depth_postorder_begin(size_type max_depth = no_depth_limit) { return depth_postorder_iterator{iter(first_), 0, max_depth}; }
+    const_depth_postorder_iterator depth_postorder_begin(size_type max_depth = no_depth_limit) const { return const_depth_postorder_iterator{iter(first_), 0, max_depth}; }
+
+    depth_postorder_iterator depth_postorder_end() { return {}; }
+    const_depth_postorder_iterator depth_postorder_end() const { return {}; }
+
+    // Iteration over the subtree rooted at i, in preorder or postorder. The end
+    // iterator is the node that follows the subtree, found once in O(depth), so
+    // each step is no dearer than in iteration over the whole forest.
+
+    preorder_iterator subtree_begin(const iterator_mc<false>& i) { return preorder_iterator{i}; }
+    const_preorder_iterator subtree_begin(const iterator_mc<true>& i) const { return const_preorder_iterator{i}; }
+
+    preorder_iterator subtree_end(const iterator_mc<false>& i) { return preorder_iterator{i.preorder_skip()}; }
+    const_preorder_iterator subtree_end(const iterator_mc<true>& i) const { return const_preorder_iterator{i.preorder_skip()}; }
+
+    postorder_iterator subtree_postorder_begin(const iterator_mc<false>& i) { return postorder_iterator{first_leaf_below(i)}; }
+    const_postorder_iterator subtree_postorder_begin(const iterator_mc<true>& i) const { return const_postorder_iterator{first_leaf_below(i)}; }
+
+    postorder_iterator subtree_postorder_end(const iterator_mc<false>& i) { return postorder_iterator{i.postorder_next()}; }
+    const_postorder_iterator subtree_postorder_end(const iterator_mc<true>& i) const { return const_postorder_iterator{i.postorder_next()}; }
+
+    // Preorder visit of the whole forest, or of the subtree rooted at i. The
+    // visitor is called with a preorder iterator to each node, and returns
+    // forest_descend to continue, forest_prune to skip the node's descendants,
+    // or forest_stop to finish. Returns an iterator to the node at which the
+    // visit stopped, or the end of the range.
+
+    template <typename Visitor>
+    iterator visit(Visitor&& visitor) { return visit_impl(begin(), end(), visitor); }
+
+    template <typename Visitor>
+    const_iterator visit(Visitor&& visitor) const { return visit_impl(begin(), end(), visitor); }
+
+    template <typename Visitor>
+    iterator visit(const iterator_mc<false>& i, Visitor&& visitor) { return visit_impl(subtree_begin(i), subtree_end(i), visitor); }
+
+    template <typename Visitor>
+    const_iterator visit(const iterator_mc<true>& i, Visitor&& visitor) const { return visit_impl(subtree_begin(i), subtree_end(i), visitor); }
+
+    // Insertion and emplace operations follow ordered_forest: all return an
+    // iterator to the last inserted node, or to the referenced node (or first
+    // tree, for graft_front) if nothing is inserted, and the iterator argument
+    // may not be an end iterator.
+
+    // Insert/emplace item as next sibling.
+
+    template <typename Iter, typename = std::enable_if_t<std::is_base_of<iterator_mc<false>, Iter>::value>>
+    Iter insert_after(const Iter& i, const V& item) {
+        return emplace_after(i, item);
+    }
+
+    template <typename Iter, typename = std::enable_if_t<std::is_base_of<iterator_mc<false>, Iter>::value>>
+    Iter insert_after(const Iter& i, V&& item) {
+        return emplace_after(i, std::move(item));
+    }
+
+    template <typename Iter, typename... Args, typename = std::enable_if_t<std::is_base_of<iterator_mc<false>, Iter>::value>>
+    Iter emplace_after(const Iter& i, Args&&... args) {
+        assert_valid(i);
+        Index x = make_node(std::forward<Args>(args)...);
+        return iter(splice_impl(nodes_[i.i_].parent_, i.i_, x));
+    }
+
+    // Insert trees in forest as next siblings.
+
+    template <typename Iter, typename = std::enable_if_t<std::is_base_of<iterator_mc<false>, Iter>::value>>
+    Iter graft_after(const Iter& i, indexed_forest of) {
+        assert_valid(i);
+        if (of.empty()) return i;
+
+        Index sp_first = take_trees(of);
+        return iter(splice_impl(nodes_[i.i_].parent_, i.i_, sp_first));
+    }
+
+    // Insert item as first child.
+
+    template <typename Iter, typename = std::enable_if_t<std::is_base_of<iterator_mc<false>, Iter>::value>>
+    Iter push_child(const Iter& i, const V& item) {
+        return emplace_child(i, item);
+    }
+
+    template <typename Iter, typename = std::enable_if_t<std::is_base_of<iterator_mc<false>, Iter>::value>>
+    Iter push_child(const Iter& i, V&& item) {
+        return emplace_child(i, std::move(item));
+    }
+
+    template <typename Iter, typename... Args, typename = std::enable_if_t<std::is_base_of<iterator_mc<false>, Iter>::value>>
+    Iter emplace_child(const Iter& i, Args&&... args) {
+        assert_valid(i);
+        Index x = make_node(std::forward<Args>(args)...);
+        return iter(splice_impl(i.i_, npos, x));
+    }
+
+    // Insert trees in forest as first children.
+
+    template <typename Iter, typename = std::enable_if_t<std::is_base_of<iterator_mc<false>, Iter>::value>>
+    Iter graft_child(const Iter& i, indexed_forest of) {
+        assert_valid(i);
+        if (of.empty()) return i;
+
+        Index sp_first = take_trees(of);
+        return iter(splice_impl(i.i_, npos, sp_first));
+    }
+
+    // Insert item as last child; linear in the number of children.
+
+    template <typename Iter, typename = std::enable_if_t<std::is_base_of<iterator_mc<false>, Iter>::value>>
+    Iter push_back_child(const Iter& i, const V& item) {
+        return emplace_back_child(i, item);
+    }
+
+    template <typename Iter, typename = std::enable_if_t<std::is_base_of<iterator_mc<false>, Iter>::value>>
+    Iter push_back_child(const Iter& i, V&& item) {
+        return emplace_back_child(i, std::move(item));
+    }
+
+    template <typename Iter, typename... Args, typename = std::enable_if_t<std::is_base_of<iterator_mc<false>, Iter>::value>>
+    Iter emplace_back_child(const Iter& i, Args&&... args) {
+        assert_valid(i);
+        Index x = make_node(std::forward<Args>(args)...);
+
+        Index prev = nodes_[i.i_].child_;
+        if (prev!=npos) while (nodes_[prev].next_!=npos) prev = nodes_[prev].next_;
+        return iter(splice_impl(i.i_, prev, x));
+    }
+
+    // Insert item as first top-level tree.
+
+    iterator push_front(const V& item) { return emplace_front(item); }
+    iterator push_front(V&& item) { return emplace_front(std::move(item)); }
+
+    template <typename... Args>
+    iterator emplace_front(Args&&... args) {
+        Index x = make_node(std::forward<Args>(args)...);
+        return iter(splice_impl(npos, npos, x));
+    }
+
+    // Insert trees in forest as first top-level trees.
+
+    iterator graft_front(indexed_forest of) {
+        if (of.empty()) return {};
+
+        Index sp_first = take_trees(of);
+        return iter(splice_impl(npos, npos, sp_first));
+    }
+
+    // Insert item as last top-level tree.
+
+    iterator push_back(const V& item) { return emplace_back(item); }
+    iterator push_back(V&& item) { return emplace_back(std::move(item)); }
+
+    template <typename... Args>
+    iterator emplace_back(Args&&... args) {
+        Index x = make_node(std::forward<Args>(args)...);
+        return iter(splice_impl(npos, last_, x));
+    }
+
+    // Erase and cut operations, as for ordered_forest:
+    //
+    // * Erase/pop operations replace a node with all of that node's children.
+    // * Prune operations remove a whole subtree, and return it as a new forest.
+
+    // Erase/cut next sibling.
+
+    void erase_after(const iterator_mc<false>& i) {
+        assert_valid(i.next()), erase_impl(nodes_[i.i_].parent_, i.i_);
+    }
+
+    indexed_forest prune_after(const iterator_mc<false>& i) {
+        return assert_valid(i.next()), prune_impl(nodes_[i.i_].parent_, i.i_);
+    }
+
+    // Erase/cut first child.
+
+    void erase_child(const iterator_mc<false>& i) {
+        assert_valid(i.child()), erase_impl(i.i_, npos);
+    }
+
+    indexed_forest prune_child(const iterator_mc<false>& i) {
+        return assert_valid(i.child()), prune_impl(i.i_, npos);
+    }
+
+    // Erase/cut root of first tree. Precondition: forest is non-empty.
+
+    void erase_front() {
+        assert_nonempty(), erase_impl(npos, npos);
+    }
+
+    indexed_forest prune_front() {
+        return assert_nonempty(), prune_impl(npos, npos);
+    }
+
+    // Remove all trees; retains the node array.
+
+    void clear() {
+        for (Index x = 0; x<high_; ++x) {
+            if (nodes_[x].parent_!=dead) item_alloc_traits::destroy(item_alloc_, nodes_[x].item());
+        }
+        high_ = 0;
+        free_ = first_ = last_ = npos;
+        size_ = 0;
+    }
+
+    // Access by reference to root of first or last tree.
+
+    V& front() { return *nodes_[first_].item(); }
+    const V& front() const { return *nodes_[first_].item(); }
+
+    V& back() { return *nodes_[last_].item(); }
+    const V& back() const { return *nodes_[last_].item(); }
+
+    // Comparison:
+
+    bool operator==(const indexed_forest& other) const {
+        const_iterator a = begin();
+        const_iterator b = other.begin();
+
+        while (a && b) {
+            if (!a.child() != !b.child() || !a.next() != !b.next() || !(*a==*b)) return false;
+            ++a, ++b;
+        }
+        return !a && !b;
+    }
+
+    bool operator!=(const indexed_forest& other) const {
+        return !(*this==other);
+    }
+
+    // Constructors, assignment, destructors:
+
+    indexed_forest(const Allocator& alloc = Allocator()) noexcept:
+        item_alloc_(alloc),
+        node_alloc_(alloc)
+    {}
+
+    indexed_forest(indexed_forest&& other) noexcept:
+        indexed_forest(std::move(other.item_alloc_))
+    {
+        steal(other);
+    }
+
+    indexed_forest(indexed_forest&& other, const Allocator& alloc):
+        indexed_forest(alloc)
+    {
+        if (allocators_equal(other)) {
+            steal(other);
+        }
+        else if (!other.empty()) {
+            splice_impl(npos, npos, take_trees(other));
+        }
+    }
+
+    indexed_forest(const indexed_forest& other):
+        indexed_forest(item_alloc_traits::select_on_container_copy_construction(other.item_alloc_))
+    {
+        copy_impl(other);
+    }
+
+    indexed_forest(const indexed_forest& other, const Allocator& alloc):
+        indexed_forest(alloc)
+    {
+        copy_impl(other);
+    }
+
+    // Conversion from ordered_forest.
+
+    template <typename OtherAllocator, unsigned Features>
+    explicit indexed_forest(const ordered_forest<V, OtherAllocator, Features>& other, const Allocator& alloc = Allocator()):
+        indexed_forest(alloc)
+    {
+        copy_impl(other);
+    }
+
+    indexed_forest(std::initializer_list<ordered_forest_builder<V, Allocator, 0>> blist, const Allocator& alloc = Allocator{}):
+        indexed_forest(ordered_forest<V, Allocator>(blist, alloc), alloc)
+    {}
+
+    indexed_forest& operator=(const indexed_forest& other) {
+        if (this==&other) return *this;
+        clear();
+
+        if (item_alloc_traits::propagate_on_container_copy_assignment::value ||
+            node_alloc_traits::propagate_on_container_copy_assignment::value)
+        {
+            release();
+            if (item_alloc_traits::propagate_on_container_copy_assignment::value) {
+                item_alloc_ = other.item_alloc_;
+            }
+            if (node_alloc_traits::propagate_on_container_copy_assignment::value) {
+                node_alloc_ = other.node_alloc_;
+            }
+        }
+
+        copy_impl(other);
+        return *this;
+    }
+
+    indexed_forest& operator=(indexed_forest&& other) {
+        if (this==&other) return *this;
+        clear();
+
+        if (item_alloc_traits::propagate_on_container_move_assignment::value) {
+            item_alloc_ = other.item_alloc_;
+        }
+        if (node_alloc_traits::propagate_on_container_move_assignment::value) {
+            release();
+            node_alloc_ = other.node_alloc_;
+        }
+
+        if (allocators_equal(other)) {
+            release();
+            steal(other);
+        }
+        else if (!other.empty()) {
+            splice_impl(npos, npos, take_trees(other));
+        }
+        return *this;
+    }
+
+    ~indexed_forest() {
+        clear();
+        release();
+    }
+
+    // Swap
+
+    void swap(indexed_forest& other)
+        noexcept(
+            (item_alloc_traits::propagate_on_container_swap::value && node_alloc_traits::propagate_on_container_swap::value) ||
+            (item_alloc_traits::is_always_equal::value && node_alloc_traits::is_always_equal::value)
+        )
+    {
+        using std::swap;
+        if (item_alloc_traits::propagate_on_container_swap::value) {
+            swap(item_alloc_, other.item_alloc_);
+        }
+        if (node_alloc_traits::propagate_on_container_swap::value) {
+            swap(node_alloc_, other.node_alloc_);
+        }
+
+        swap(nodes_, other.nodes_);
+        swap(capacity_, other.capacity_);
+        swap(high_, other.high_);
+        swap(free_, other.free_);
+        swap(first_, other.first_);
+        swap(last_, other.last_);
+        swap(size_, other.size_);
+    }
+
+    friend void swap(indexed_forest& a, indexed_forest& b) {
+        a.swap(b);
+    }
+
+    // Allocator access
+
+    allocator_type get_allocator() const noexcept { return item_alloc_; }
+
+private:
+    Allocator item_alloc_;
+    node_alloc_t node_alloc_;
+
+    // Node array: slots [0, high_) have been used; free slots among them are
+    // marked dead and threaded through next_ from free_.
+    node* nodes_ = nullptr;
+    size_type capacity_ = 0;
+    Index high_ = 0;
+    Index free_ = npos;
+
+    Index first_ = npos;
+    Index last_ = npos;
+    size_type size_ = 0;
+
+    bool allocators_equal(const indexed_forest& other) const {
+        return item_alloc_==other.item_alloc_ && node_alloc_==other.node_alloc_;
+    }
+
+    iterator_mc<false> iter(Index i) { return i==npos? iterator_mc<false>{}: iterator_mc<false>(&nodes_, i); }
+    iterator_mc<true> iter(Index i) const { return i==npos? iterator_mc<true>{}: iterator_mc<true>(&nodes_, i); }
+
+    template <typename Iter, typename Visitor>
+    static Iter visit_impl(Iter i, Iter end, Visitor& visitor) {
+        while (i!=end) {
+            switch (visitor(static_cast<const Iter&>(i))) {
+            case forest_stop:
+                return i;
+            case forest_prune:
+                i.skip_subtree();
+                break;
+            default:
+                ++i;
+            }
+        }
+        return i;
+    }
+
+    template <bool flag>
+    static iterator_mc<flag> first_leaf_below(iterator_mc<flag> i) {
+        while (auto c = i.child()) i = c;
+        return i;
+    }
+
+    Index first_leaf() const {
+        Index x = first_;
+        if (x!=npos) while (nodes_[x].child_!=npos) x = nodes_[x].child_;
+        return x;
+    }
+
+    // Throw on invalid iterator.
+    template <bool flag>
+    void assert_valid(const iterator_mc<flag>& i) {
+        if (!i) throw std::invalid_argument("bad iterator");
+    }
+
+    void assert_nonempty() {
+        if (empty()) throw std::invalid_argument("empty forest");
+    }
+
+    void steal(indexed_forest& other) {
+        nodes_ = std::exchange(other.nodes_, nullptr);
+        capacity_ = std::exchange(other.capacity_, 0);
+        high_ = std::exchange(other.high_, 0);
+        free_ = std::exchange(other.free_, npos);
+        first_ = std::exchange(other.first_, npos);
+        last_ = std::exchange(other.last_, npos);
+        size_ = std::exchange(other.size_, 0);
+    }
+
+    // Deallocate the node array. Precondition: the forest is cleared.
+
+    void release() {
+        if (nodes_) node_alloc_traits::deallocate(node_alloc_, nodes_, capacity_);
+        nodes_ = nullptr;
+        capacity_ = 0;
+    }
+
+    // The link to the node following prev, or to the first child of parent if
+    // prev is npos, or to the first tree if parent is also npos. References are
+    // invalidated by reallocation of the node array.
+
+    Index& link(Index parent, Index prev) {
+        return prev!=npos? nodes_[prev].next_: parent!=npos? nodes_[parent].child_: first_;
+    }
+
+    // Link the sibling list beginning sp_first into the forest after prev, or
+    // at the front of parent's children (or of the top-level trees) if prev is
+    // npos. Returns the last linked node.
+
+    Index splice_impl(Index parent, Index prev, Index sp_first) {
+        Index sp_last = npos;
+        for (Index j = sp_first; j!=npos; j = nodes_[j].next_) {
+            nodes_[j].parent_ = parent;
+            sp_last = j;
+        }
+
+        Index& next_write = link(parent, prev);
+        if (next_write==npos && parent==npos) last_ = sp_last;
+        nodes_[sp_last].next_ = next_write;
+        next_write = sp_first;
+        return sp_last;
+    }
+
+    void erase_impl(Index parent, Index prev) {
+        Index& next_write = link(parent, prev);
+        Index x = next_write;
+        next_write = nodes_[x].next_;
+
+        if (nodes_[x].child_!=npos) {
+            splice_impl(parent, prev, std::exchange(nodes_[x].child_, npos));
+        }
+        else if (next_write==npos && parent==npos) {
+            last_ = prev;
+        }
+        free_node(x);
+    }
+
+    indexed_forest prune_impl(Index parent, Index prev) {
+        Index r = link(parent, prev);
+
+        // Move the subtree into the new forest before unlinking it here.
+        indexed_forest f(get_allocator());
+        f.reserve(count_subtree(r));
+        f.splice_impl(npos, npos, f.template import_trees<true>(iter(r), true));
+
+        Index& next_write = link(parent, prev);
+        next_write = nodes_[r].next_;
+        if (next_write==npos && parent==npos) last_ = prev;
+
+        nodes_[r].next_ = npos;
+        free_trees(r);
+        return f;
+    }
+
+    // Move the trees of non-empty other into this forest as a detached sibling
+    // list; returns the first index. Free slots number high_-size_.
+
+    Index take_trees(indexed_forest& other) {
+        reserve(std::max(size_type(high_), size_+other.size_));
+        Index first = import_trees<true>(other.root_begin(), false);
+        other.clear();
+        return first;
+    }
+
+    size_type count_subtree(Index r) const {
+        size_type k = 0;
+        for (auto i = iter(r); i; ) {
+            ++k;
+            if (i.child()) {
+                i = i.child();
+            }
+            else {
+                while (i.i_!=r && !i.next()) i = i.parent();
+                i = i.i_==r? iterator_mc<true>{}: i.next();
+            }
+        }
+        return k;
+    }
+
+    template <typename Forest>
+    void copy_impl(const Forest& other) {
+        reserve(other.size());
+        if (!other.empty()) splice_impl(npos, npos, import_trees<false>(other.root_begin(), false));
+    }
+
+    // Create copies (or, if move_items is true, moves) of the tree at i, or of
+    // i and its following siblings if single_tree is false, as a detached
+    // sibling list, linked in preorder. Returns the first index. If an item
+    // construction throws, the partial copy is freed.
+
+    template <bool move_items, typename SrcIter>
+    Index import_trees(SrcIter i, bool single_tree) {
+        SrcIter root = i;
+        Index first = npos;
+        Index parent = npos;
+        Index prev = npos;
+
+        try {
+            while (i) {
+                Index x = make_node(source_item(*i, std::integral_constant<bool, move_items>{}));
+                nodes_[x].parent_ = parent;
+                if (prev!=npos) nodes_[prev].next_ = x;
+                else if (parent!=npos) nodes_[parent].child_ = x;
+                else first = x;
+
+                if (i.child()) {
+                    i = i.child();
+                    parent = x;
+                    prev = npos;
+                    continue;
+                }
+
+                prev = x;
+                for (;;) {
+                    if (single_tree && i==root) {
+                        i = SrcIter{};
+                        break;
+                    }
+                    if (i.next()) {
+                        i = i.next();
+                        break;
+                    }
+                    i = i.parent();
+                    if (!i) break;
+
+                    prev = parent;
+                    parent = nodes_[parent].parent_;
+                }
+            }
+        }
+        catch (...) {
+            free_trees(first);
+            throw;
+        }
+        return first;
+    }
+
+    template <typename T>
+    static decltype(auto) source_item(T& item, std::true_type) { return std::move_if_noexcept(item); }
+
+    template <typename T>
+    static const T& source_item(T& item, std::false_type) { return item; }
+
+    // Node creation, destruction:
+
+    // Construct a new node; if the node array must grow, the item is constructed
+    // in the new array before existing items are moved, so that args may refer
+    // to items in this forest.
+
+    template <typename... Args>
+    Index make_node(Args&&... args) {
+        Index x;
+        if (free_!=npos) {
+            x = free_;
+            construct_item(nodes_+x, std::forward<Args>(args)...);
+            free_ = nodes_[x].next_;
+        }
+        else if (high_<capacity_) {
+            x = high_;
+            construct_item(nodes_+x, std::forward<Args>(args)...);
+            ++high_;
+        }
+        else {
+            if (capacity_>=max_size()) throw std::length_error("indexed_forest: too many nodes");
+            size_type new_capacity = std::min(max_size(), std::max(size_type(16), 2*capacity_));
+
+            x = high_;
+            relocate(new_capacity, [&](node* ns) { construct_item(ns+x, std::forward<Args>(args)...); return true; });
+            ++high_;
+        }
+
+        nodes_[x].parent_ = nodes_[x].child_ = nodes_[x].next_ = npos;
+        ++size_;
+        return x;
+    }
+
+    template <typename... Args>
+    void construct_item(node* n, Args&&... args) {
+        item_alloc_traits::construct(item_alloc_, n->item(), std::forward<Args>(args)...);
+    }
+
+    // Move the nodes to a new array of the given capacity, after calling
+    // prepare on the new array; prepare returns true if it constructed an item
+    // in the slot at high_. Provides the strong guarantee if items are copyable
+    // or nothrow movable.
+
+    template <typename Prepare>
+    void relocate(size_type new_capacity, Prepare&& prepare) {
+        node* ns = node_alloc_traits::allocate(node_alloc_, new_capacity);
+        bool prepared = false;
+        Index moved = 0;
+
+        try {
+            prepared = prepare(ns);
+            for (; moved<high_; ++moved) {
+                node& from = nodes_[moved];
+                node& to = ns[moved];
+
+                to.parent_ = from.parent_;
+                to.child_ = from.child_;
+                to.next_ = from.next_;
+                if (from.parent_!=dead) construct_item(&to, std::move_if_noexcept(*from.item()));
+            }
+        }
+        catch (...) {
+            for (Index x = 0; x<moved; ++x) {
+                if (ns[x].parent_!=dead) item_alloc_traits::destroy(item_alloc_, ns[x].item());
+            }
+            if (prepared) item_alloc_traits::destroy(item_alloc_, ns[high_].item());
+            node_alloc_traits::deallocate(node_alloc_, ns, new_capacity);
+            throw;
+        }
+
+        for (Index x = 0; x<high_; ++x) {
+            if (nodes_[x].parent_!=dead) item_alloc_traits::destroy(item_alloc_, nodes_[x].item());
+        }
+        if (nodes_) node_alloc_traits::deallocate(node_alloc_, nodes_, capacity_);
+
+        nodes_ = ns;
+        capacity_ = new_capacity;
+    }
+
+    void free_node(Index x) {
+        item_alloc_traits::destroy(item_alloc_, nodes_[x].item());
+        nodes_[x].parent_ = dead;
+        nodes_[x].child_ = npos;
+        nodes_[x].next_ = free_;
+        free_ = x;
+        --size_;
+    }
+
+    // Free x, its subtree, and its following siblings in constant stack space,
+    // as for ordered_forest::delete_node.
+
+    void free_trees(Index x) {
+        while (x!=npos) {
+            node& n = nodes_[x];
+            if (n.child_!=npos) {
+                Index c = n.child_;
+                n.child_ = nodes_[c].next_;
+                nodes_[c].next_ = x;
+                x = c;
+            }
+            else {
+                Index next = n.next_;
+                free_node(x);
+                x = next;
+            }
+        }
+    }
+};
+
+template <typename V, typename Allocator, typename Index>
+constexpr Index indexed_forest<V, Allocator, Index>::npos;
+
+template <typename V, typename Allocator, typename Index>
+constexpr Index indexed_forest<V, Allocator, Index>::dead;
+
+template <typename V, typename Allocator, typename Index>
+constexpr typename indexed_forest<V, Allocator, Index>::size_type indexed_forest<V, Allocator, Index>::no_depth_limit;
+
+#endif // ndef INDEXED_FOREST_H_
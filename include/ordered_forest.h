@@ -1,28 +1,142 @@
 #ifndef ORDERED_FOREST_H_
 #define ORDERED_FOREST_H_
 
+#include <algorithm>
+#include <functional>
 #include <type_traits>
 #include <iterator>
 #include <memory>
+#include <stdexcept>
 #include <utility>
+#include <vector>
 
-template <typename V, typename Allocator>
+// Optional features are selected by the bitwise or of the following
+// flags, supplied as the third template parameter of ordered_forest.
+//
+// * forest_node_pool: nodes are carved from large slabs and recycled through
+//   a free list. The pool is shared between a forest and those pruned from it,
+//   so that nodes can move between them without reallocation. The pool is
+//   not synchronized: forests sharing a pool must not be modified (or
+//   destroyed) concurrently, even though they are distinct objects.
+//
+// * forest_subtree_size: each node records the size of its subtree, making
+//   prune O(depth) and subtree_size() O(1), and speeding preorder_rank() and
+//   nth_preorder(). Insertion and erasure become O(depth).
+//
+// * forest_last_child: each node records its last child, making
+//   push_back_child() and emplace_back_child() O(1). (Appending a top-level
+//   tree is O(1) regardless.)
+//
+// * forest_prev_sibling: each node records its previous sibling, with the
+//   first sibling recording the last, so that sibling lists are circular in
+//   that direction. Iterators gain prev() and operator--, reverse iteration is
+//   supported, erase(i) and prune(i) are O(1) (as is push_back_child()), and
+//   the cost of insertion and erasure rises by a constant.
+//
+// * forest_preorder_thread: each node records the node following its subtree
+//   in preorder, so that preorder increments, skip_subtree() and subtree_end()
+//   are O(1) in the worst case rather than O(depth). Insertion, erasure and
+//   pruning must then update the escape links along the rightmost path below
+//   the preceding sibling, costing O(depth) per edit (more without
+//   forest_last_child or forest_prev_sibling, which find that path directly).
+//
+// * forest_lazy_parent: only the last of a list of siblings records their
+//   parent, so that linking in a list of trees need not visit each of them:
+//   graft operations and the lifting of children by erase become O(1) (the
+//   latter needing forest_last_child or forest_prev_sibling to find the last
+//   child), plus the O(depth) upkeep of other features. In exchange, parent()
+//   costs O(1) plus the number of following siblings, as do erase(i) and
+//   prune(i) for a first child and preorder_rank().
+
+enum ordered_forest_feature: unsigned {
+    forest_node_pool = 1u<<0,
+    forest_subtree_size = 1u<<1,
+    forest_last_child = 1u<<2,
+    forest_prev_sibling = 1u<<3,
+    forest_preorder_thread = 1u<<4,
+    forest_lazy_parent = 1u<<5
+};
+
+// Visitor results for ordered_forest::visit().
+
+enum forest_visit: unsigned {
+    forest_descend,
+    forest_prune,
+    forest_stop
+};
+
+template <typename V, typename Allocator, unsigned Features>
 struct ordered_forest_builder;
 
-template <typename V, typename Allocator = std::allocator<V>>
+template <typename V, typename Allocator = std::allocator<V>, unsigned Features = 0>
 struct ordered_forest {
 private:
-    struct node {
-        V* item_ = nullptr;
+    static constexpr bool pooled = Features & forest_node_pool;
+    static constexpr bool augmented = Features & forest_subtree_size;
+    static constexpr bool has_last_child = Features & forest_last_child;
+    static constexpr bool has_prev = Features & forest_prev_sibling;
+    static constexpr bool threaded = Features & forest_preorder_thread;
+    static constexpr bool lazy_parent = Features & forest_lazy_parent;
+
+    // Per-node fields for optional features are supplied by empty or non-empty
+    // base classes; feature-specific code is selected by tag dispatch.
+
+    using augmented_tag = std::integral_constant<bool, augmented>;
+    using last_child_tag = std::integral_constant<bool, has_last_child>;
+    using prev_tag = std::integral_constant<bool, has_prev>;
+    using thread_tag = std::integral_constant<bool, threaded>;
+    using lazy_parent_tag = std::integral_constant<bool, lazy_parent>;
+
+    template <bool flag, typename = void>
+    struct subtree_size_field {};
+
+    template <typename X>
+    struct subtree_size_field<true, X> {
+        std::size_t subtree_size_ = 1;
+    };
+
+    template <bool flag, typename N>
+    struct last_child_field {};
+
+    template <typename N>
+    struct last_child_field<true, N> {
+        N* last_child_ = nullptr;
+    };
+
+    template <bool flag, typename N>
+    struct prev_sibling_field {};
+
+    template <typename N>
+    struct prev_sibling_field<true, N> {
+        N* prev_ = nullptr;
+    };
+
+    template <bool flag, typename N>
+    struct preorder_thread_field {};
+
+    template <typename N>
+    struct preorder_thread_field<true, N> {
+        N* skip_ = nullptr;
+    };
+
+    // Items are stored inline after the links; the item storage is constructed
+    // and destroyed separately from the node, via the item allocator.
+
+    struct node: subtree_size_field<augmented>, last_child_field<has_last_child, node>, prev_sibling_field<has_prev, node>, preorder_thread_field<threaded, node> {
         node* parent_ = nullptr;
         node* child_ = nullptr;
         node* next_ = nullptr;
+        std::aligned_storage_t<sizeof(V), alignof(V)> item_;
+
+        V* item() { return reinterpret_cast<V*>(&item_); }
     };
 
     using node_alloc_t = typename std::allocator_traits<Allocator>::template rebind_alloc<node>;
     using item_alloc_traits = std::allocator_traits<Allocator>;
     using node_alloc_traits = std::allocator_traits<node_alloc_t>;
 
+    struct node_pool;
+
 public:
     using value_type = V;
     using allocator_type = Allocator;
@@ -53,20 +167,27 @@ public:
         template <bool flag = const_flag, typename std::enable_if_t<flag, int> = 0>
         iterator_mc(const iterator_mc<false>& i): iterator_base(i.n_) {}
 
-        iterator_mc parent() const { return iterator_mc{n_? n_->parent_: nullptr}; }
+        iterator_mc parent() const { return iterator_mc{n_? parent_of(n_): nullptr}; }
         iterator_mc next() const { return iterator_mc{n_? n_->next_: nullptr}; }
         iterator_mc child() const { return iterator_mc{n_? n_->child_: nullptr}; }
 
+        // Previous sibling; requires forest_prev_sibling.
+        iterator_mc prev() const {
+            static_assert(has_prev, "prev() requires forest_prev_sibling");
+            return iterator_mc{n_ && n_->prev_->next_? n_->prev_: nullptr};
+        }
+
         bool operator==(const iterator_base& a) const { return n_ == a.n_; }
         bool operator!=(const iterator_base& a) const { return n_ != a.n_; }
 
         iterator_mc preorder_next() const {
-            if (!n_) return {};
-            if (n_->child_) return iterator_mc{n_->child_};
+            if (n_ && n_->child_) return iterator_mc{n_->child_};
+            return preorder_skip();
+        }
 
-            node* x = n_;
-            while (x && !x->next_) x = x->parent_;
-            return iterator_mc{x? x->next_: nullptr};
+        // The first node following the subtree of this node in preorder.
+        iterator_mc preorder_skip() const {
+            return iterator_mc{n_? escape(n_, thread_tag{}): nullptr};
         }
 
         iterator_mc postorder_next() const {
@@ -79,8 +200,30 @@ public:
             else return parent();
         }
 
-        reference operator*() const { return *n_->item_; }
-        pointer operator->() const { return n_->item_; }
+        // Predecessors in preorder and postorder; require forest_prev_sibling.
+
+        iterator_mc preorder_prev() const {
+            static_assert(has_prev, "preorder_prev() requires forest_prev_sibling");
+            if (!n_) return {};
+
+            node* x = n_->prev_;
+            if (!x->next_) return iterator_mc{x->parent_};
+            while (x->child_) x = x->child_->prev_;
+            return iterator_mc{x};
+        }
+
+        iterator_mc postorder_prev() const {
+            static_assert(has_prev, "postorder_prev() requires forest_prev_sibling");
+            if (!n_) return {};
+            if (n_->child_) return iterator_mc{n_->child_->prev_};
+
+            node* x = n_;
+            while (x && !x->prev_->next_) x = x->prev_->parent_;
+            return iterator_mc{x? x->prev_: nullptr};
+        }
+
+        reference operator*() const { return *n_->item(); }
+        pointer operator->() const { return n_->item(); }
 
     protected:
         friend ordered_forest;
@@ -96,6 +239,9 @@ public:
 
         sibling_iterator_mc& operator++() { return *this = this->next(); }
         sibling_iterator_mc operator++(int) { auto p = *this; return ++*this, p; }
+
+        sibling_iterator_mc& operator--() { return *this = this->prev(); }
+        sibling_iterator_mc operator--(int) { auto p = *this; return --*this, p; }
     };
 
     using sibling_iterator = sibling_iterator_mc<false>;
@@ -108,6 +254,12 @@ public:
 
         preorder_iterator_mc& operator++() { return *this = this->preorder_next(); }
         preorder_iterator_mc operator++(int) { auto p = *this; return ++*this, p; }
+
+        preorder_iterator_mc& operator--() { return *this = this->preorder_prev(); }
+        preorder_iterator_mc operator--(int) { auto p = *this; return --*this, p; }
+
+        // Advance past the subtree of the current node.
+        preorder_iterator_mc& skip_subtree() { return *this = this->preorder_skip(); }
     };
 
     using preorder_iterator = preorder_iterator_mc<false>;
@@ -120,20 +272,485 @@ public:
 
         postorder_iterator_mc& operator++() { return *this = this->postorder_next(); }
         postorder_iterator_mc operator++(int) { auto p = *this; return ++*this, p; }
+
+        postorder_iterator_mc& operator--() { return *this = this->postorder_prev(); }
+        postorder_iterator_mc operator--(int) { auto p = *this; return --*this, p; }
     };
 
     using postorder_iterator = postorder_iterator_mc<false>;
     using const_postorder_iterator = postorder_iterator_mc<true>;
 
+    // Reverse sibling, preorder and postorder iterators; these require
+    // forest_prev_sibling, as do the decrement operators above. Decrement is
+    // not defined on end iterators, which carry no reference to their forest:
+    // reverse traversal starts from the rbegin() family instead.
+
+    template <bool const_flag>
+    struct reverse_sibling_iterator_mc: iterator_mc<const_flag> {
+        reverse_sibling_iterator_mc() = default;
+        reverse_sibling_iterator_mc(const iterator_mc<const_flag>& i): iterator_mc<const_flag>(i) {}
+
+        reverse_sibling_iterator_mc& operator++() { return *this = this->prev(); }
+        reverse_sibling_iterator_mc operator++(int) { auto p = *this; return ++*this, p; }
+
+        reverse_sibling_iterator_mc& operator--() { return *this = this->next(); }
+        reverse_sibling_iterator_mc operator--(int) { auto p = *this; return --*this, p; }
+    };
+
+    using reverse_sibling_iterator = reverse_sibling_iterator_mc<false>;
+    using const_reverse_sibling_iterator = reverse_sibling_iterator_mc<true>;
+
+    template <bool const_flag>
+    struct reverse_preorder_iterator_mc: iterator_mc<const_flag> {
+        reverse_preorder_iterator_mc() = default;
+        reverse_preorder_iterator_mc(const iterator_mc<const_flag>& i): iterator_mc<const_flag>(i) {}
+
+        reverse_preorder_iterator_mc& operator++() { return *this = this->preorder_prev(); }
+        reverse_preorder_iterator_mc operator++(int) { auto p = *this; return ++*this, p; }
+
+        reverse_preorder_iterator_mc& operator--() { return *this = this->preorder_next(); }
+        reverse_preorder_iterator_mc operator--(int) { auto p = *this; return --*this, p; }
+    };
+
+    using reverse_preorder_iterator = reverse_preorder_iterator_mc<false>;
+    using const_reverse_preorder_iterator = reverse_preorder_iterator_mc<true>;
+
+    template <bool const_flag>
+    struct reverse_postorder_iterator_mc: iterator_mc<const_flag> {
+        reverse_postorder_iterator_mc() = default;
+        reverse_postorder_iterator_mc(const iterator_mc<const_flag>& i): iterator_mc<const_flag>(i) {}
+
+        reverse_postorder_iterator_mc& operator++() { return *this = this->postorder_prev(); }
+        reverse_postorder_iterator_mc operator++(int) { auto p = *this; return ++*this, p; }
+
+        reverse_postorder_iterator_mc& operator--() { return *this = this->postorder_next(); }
+        reverse_postorder_iterator_mc operator--(int) { auto p = *this; return --*this, p; }
+    };
+
+    using reverse_postorder_iterator = reverse_postorder_iterator_mc<false>;
+    using const_reverse_postorder_iterator = reverse_postorder_iterator_mc<true>;
+
+    // Leaf iterators step directly from each leaf to the next, in the order
+    // common to preorder and postorder, without stopping at internal nodes.
+
+    template <bool const_flag>
+    struct leaf_iterator_mc: iterator_mc<const_flag> {
+        leaf_iterator_mc() = default;
+        leaf_iterator_mc(const iterator_mc<const_flag>& i): iterator_mc<const_flag>(i) {}
+
+        leaf_iterator_mc& operator++() { return *this = first_leaf_below(this->preorder_skip()); }
+        leaf_iterator_mc operator++(int) { auto p = *this; return ++*this, p; }
+    };
+
+    using leaf_iterator = leaf_iterator_mc<false>;
+    using const_leaf_iterator = leaf_iterator_mc<true>;
+
+    // Ancestor iterators step from a node to its parent, ending after the root.
+
+    template <bool const_flag>
+    struct ancestor_iterator_mc: iterator_mc<const_flag> {
+        ancestor_iterator_mc() = default;
+        ancestor_iterator_mc(const iterator_mc<const_flag>& i): iterator_mc<const_flag>(i) {}
+
+        ancestor_iterator_mc& operator++() { return *this = this->parent(); }
+        ancestor_iterator_mc operator++(int) { auto p = *this; return ++*this, p; }
+    };
+
+    using ancestor_iterator = ancestor_iterator_mc<false>;
+    using const_ancestor_iterator = ancestor_iterator_mc<true>;
+
+    // A begin and end iterator pair, for use in range-based for loops.
+
+    template <typename Iter>
+    struct iterator_range {
+        Iter first, last;
+
+        Iter begin() const { return first; }
+        Iter end() const { return last; }
+    };
+
+    // Preorder and postorder iterators that track the depth of the current node
+    // incrementally, and that never descend below max_depth: nodes at that depth
+    // are treated as leaves. Depths are relative to the starting node, which is
+    // taken to be at the given depth.
+
+    static constexpr size_type no_depth_limit = size_type(-1);
+
+    template <bool const_flag>
+    struct depth_preorder_iterator_mc: iterator_mc<const_flag> {
+        depth_preorder_iterator_mc() = default;
+        explicit depth_preorder_iterator_mc(const iterator_mc<const_flag>& i, size_type depth = 0, size_type max_depth = no_depth_limit):
+            iterator_mc<const_flag>(i), depth_(depth), max_depth_(max_depth) {}
+
+        size_type depth() const { return depth_; }
+        size_type max_depth() const { return max_depth_; }
+
+        depth_preorder_iterator_mc& operator++() {
+            node* x = this->n_;
+            if (x && x->child_ && depth_<max_depth_) {
+                this->n_ = x->child_;
+                ++depth_;
+                return *this;
+            }
+            return skip_subtree();
+        }
+
+        depth_preorder_iterator_mc operator++(int) { auto p = *this; return ++*this, p; }
+
+        // Advance past the subtree of the current node.
+        depth_preorder_iterator_mc& skip_subtree() {
+            node* x = this->n_;
+            while (x && !x->next_) {
+                x = x->parent_;
+                --depth_;
+            }
+            this->n_ = x? x->next_: nullptr;
+            return *this;
+        }
+
+    private:
+        size_type depth_ = 0;
+        size_type max_depth_ = no_depth_limit;
+    };
+
+    using depth_preorder_iterator = depth_preorder_iterator_mc<false>;
+    using const_depth_preorder_iterator = depth_preorder_iterator_mc<true>;
+
+    template <bool const_flag>
+    struct depth_postorder_iterator_mc: iterator_mc<const_flag> {
+        depth_postorder_iterator_mc() = default;
+
+        // Start at the first node in postorder of the (depth-limited) tree at i.
+        explicit depth_postorder_iterator_mc(const iterator_mc<const_flag>& i, size_type depth = 0, size_type max_depth = no_depth_limit):
+            iterator_mc<const_flag>(i), depth_(depth), max_depth_(max_depth)
+        {
+            descend();
+        }
+
+        size_type depth() const { return depth_; }
+        size_type max_depth() const { return max_depth_; }
+
+        depth_postorder_iterator_mc& operator++() {
+            node* x = this->n_;
+            if (!x) return *this;
+            if (x->next_) {
+                this->n_ = x->next_;
+                descend();
+            }
+            else {
+                this->n_ = x->parent_;
+                --depth_;
+            }
+            return *this;
+        }
+
+        depth_postorder_iterator_mc operator++(int) { auto p = *this; return ++*this, p; }
+
+    private:
+        size_type depth_ = 0;
+        size_type max_depth_ = no_depth_limit;
+
+        void descend() {
+            node* x = this->n_;
+            if (!x) return;
+            while (x->child_ && depth_<max_depth_) {
+                x = x->child_;
+                ++depth_;
+            }
+            this->n_ = x;
+        }
+    };
+
+    using depth_postorder_iterator = depth_postorder_iterator_mc<false>;
+    using const_depth_postorder_iterator = depth_postorder_iterator_mc<true>;
+
+    // Level-order (breadth-first) traversal state: the heads of the sibling
+    // lists in the current and the next level. The buffers are retained between
+    // traversals, so that after warm-up a traversal performs no allocation. A
+    // frontier serves one traversal at a time.
+
+    struct levelorder_frontier {
+        explicit levelorder_frontier(const Allocator& alloc = Allocator()):
+            heads_(node_ptr_alloc_t(alloc)),
+            next_heads_(node_ptr_alloc_t(alloc))
+        {}
+
+        // Depth of the current level of the traversal in progress.
+        size_type level() const { return level_; }
+
+        // Release the retained buffers.
+        void clear() {
+            heads_ = node_ptr_vector(heads_.get_allocator());
+            next_heads_ = node_ptr_vector(next_heads_.get_allocator());
+        }
+
+    private:
+        friend ordered_forest;
+
+        using node_ptr_alloc_t = typename std::allocator_traits<Allocator>::template rebind_alloc<node*>;
+        using node_ptr_vector = std::vector<node*, node_ptr_alloc_t>;
+
+        node_ptr_vector heads_;
+        node_ptr_vector next_heads_;
+        size_type k_ = 0;
+        size_type level_ = 0;
+
+        node* start(node* first) {
+            heads_.clear();
+            next_heads_.clear();
+            k_ = level_ = 0;
+            if (first) {
+                heads_.push_back(first);
+                visit(first);
+            }
+            return first;
+        }
+
+        void visit(node* x) {
+            if (x->child_) next_heads_.push_back(x->child_);
+        }
+
+        node* advance(node* x) {
+            if (x->next_) {
+                x = x->next_;
+            }
+            else if (++k_<heads_.size()) {
+                x = heads_[k_];
+            }
+            else {
+                std::swap(heads_, next_heads_);
+                next_heads_.clear();
+                k_ = 0;
+                ++level_;
+                x = heads_.empty()? nullptr: heads_[0];
+            }
+
+            if (x) visit(x);
+            return x;
+        }
+    };
+
+    // Level-order iterators are input iterators: copies share the state of the
+    // frontier, and only the most recently incremented copy remains valid.
+
+    template <bool const_flag>
+    struct levelorder_iterator_mc: iterator_mc<const_flag> {
+        using iterator_category = std::input_iterator_tag;
+
+        levelorder_iterator_mc() = default;
+
+        // Depth of the current node.
+        size_type level() const { return fr_->level(); }
+
+        levelorder_iterator_mc& operator++() {
+            if (this->n_) this->n_ = fr_->advance(this->n_);
+            return *this;
+        }
+
+        void operator++(int) { ++*this; }
+
+    private:
+        friend ordered_forest;
+        levelorder_frontier* fr_ = nullptr;
+
+        levelorder_iterator_mc(node* first, levelorder_frontier& fr): iterator_mc<const_flag>(first), fr_(&fr) {}
+    };
+
+    using levelorder_iterator = levelorder_iterator_mc<false>;
+    using const_levelorder_iterator = levelorder_iterator_mc<true>;
+
+    // Prefetching traversal state: a ring of nodes requested ahead of a preorder
+    // or postorder traversal. A dependent chain of loads cannot be prefetched
+    // along its own length, so the window instead expands speculatively, first
+    // in first out, from nodes it has already requested: each step takes two
+    // nodes from the ring and requests their first children and next siblings.
+    // This keeps up to distance() cache misses outstanding at once, over nodes
+    // that the traversal will reach in due course. When the ring runs dry, it
+    // is reseeded from the current node. A window serves one traversal at a
+    // time, and its buffer is retained between traversals.
+
+    static constexpr size_type default_prefetch_distance = 64;
+
+    struct prefetch_window {
+        // The distance is rounded up to a power of two.
+        explicit prefetch_window(size_type distance = default_prefetch_distance, const Allocator& alloc = Allocator()):
+            ring_(ring_size(distance), nullptr, node_ptr_alloc_t(alloc)),
+            mask_(ring_.size()-1)
+        {}
+
+        size_type distance() const { return ring_.size(); }
+
+    private:
+        friend ordered_forest;
+
+        using node_ptr_alloc_t = typename std::allocator_traits<Allocator>::template rebind_alloc<node*>;
+        using node_ptr_vector = std::vector<node*, node_ptr_alloc_t>;
+
+        node_ptr_vector ring_;
+        size_type mask_;
+        size_type head_ = 0;
+        size_type tail_ = 0;
+
+        static size_type ring_size(size_type distance) {
+            size_type k = 1;
+            while (k<distance) k *= 2;
+            return k;
+        }
+
+        void push(node* y) {
+            if (y && tail_-head_<=mask_) {
+                prefetch_node(y);
+                ring_[tail_++ & mask_] = y;
+            }
+        }
+
+        node* start(node* seed, node* first) {
+            head_ = tail_ = 0;
+            push(seed);
+            return first;
+        }
+
+        node* advance(node* x) {
+            for (int k = 0; k<2 && head_!=tail_; ++k) {
+                node* y = ring_[head_++ & mask_];
+                push(y->child_);
+                push(y->next_);
+            }
+            if (head_==tail_ && x) {
+                push(x->child_);
+                push(x->next_);
+            }
+            return x;
+        }
+    };
+
+    // Prefetching preorder and postorder iterators are input iterators: copies
+    // share the state of the window, and only the most recently incremented
+    // copy remains valid.
+
+    template <bool const_flag>
+    struct prefetch_preorder_iterator_mc: iterator_mc<const_flag> {
+        using iterator_category = std::input_iterator_tag;
+
+        prefetch_preorder_iterator_mc() = default;
+
+        prefetch_preorder_iterator_mc& operator++() {
+            if (this->n_) this->n_ = w_->advance(preorder_next_node(this->n_));
+            return *this;
+        }
+
+        void operator++(int) { ++*this; }
+
+    private:
+        friend ordered_forest;
+        prefetch_window* w_ = nullptr;
+
+        prefetch_preorder_iterator_mc(node* first, prefetch_window& w): iterator_mc<const_flag>(first), w_(&w) {}
+    };
+
+    using prefetch_preorder_iterator = prefetch_preorder_iterator_mc<false>;
+    using const_prefetch_preorder_iterator = prefetch_preorder_iterator_mc<true>;
+
+    template <bool const_flag>
+    struct prefetch_postorder_iterator_mc: iterator_mc<const_flag> {
+        using iterator_category = std::input_iterator_tag;
+
+        prefetch_postorder_iterator_mc() = default;
+
+        prefetch_postorder_iterator_mc& operator++() {
+            if (this->n_) this->n_ = w_->advance(postorder_next_node(this->n_));
+            return *this;
+        }
+
+        void operator++(int) { ++*this; }
+
+    private:
+        friend ordered_forest;
+        prefetch_window* w_ = nullptr;
+
+        prefetch_postorder_iterator_mc(node* first, prefetch_window& w): iterator_mc<const_flag>(first), w_(&w) {}
+    };
+
+    using prefetch_postorder_iterator = prefetch_postorder_iterator_mc<false>;
+    using const_prefetch_postorder_iterator = prefetch_postorder_iterator_mc<true>;
+
+    // Euler-tour iterators visit each node twice, once on entering it (before
+    // its descendants) and once on leaving it (after them), using the node links
+    // alone. Iterators compare equal only if they refer to the same event.
+
+    template <bool const_flag>
+    struct euler_iterator_mc: iterator_mc<const_flag> {
+        euler_iterator_mc() = default;
+        explicit euler_iterator_mc(const iterator_mc<const_flag>& i, bool leaving = false):
+            iterator_mc<const_flag>(i), leaving_(i && leaving) {}
+
+        bool entering() const { return !leaving_; }
+        bool leaving() const { return leaving_; }
+
+        bool operator==(const euler_iterator_mc& a) const { return this->n_==a.n_ && leaving_==a.leaving_; }
+        bool operator!=(const euler_iterator_mc& a) const { return !(*this==a); }
+
+        euler_iterator_mc& operator++() {
+            node* x = this->n_;
+            if (!x) return *this;
+
+            if (!leaving_) {
+                if (x->child_) this->n_ = x->child_;
+                else leaving_ = true;
+            }
+            else if (x->next_) {
+                this->n_ = x->next_;
+                leaving_ = false;
+            }
+            else {
+                this->n_ = x->parent_;
+                leaving_ = this->n_;
+            }
+            return *this;
+        }
+
+        euler_iterator_mc operator++(int) { auto p = *this; return ++*this, p; }
+
+    private:
+        bool leaving_ = false;
+    };
+
+    using euler_iterator = euler_iterator_mc<false>;
+    using const_euler_iterator = euler_iterator_mc<true>;
+
     bool empty() const { return !first_; }
 
-    // Note: size is O(n) in the number of elements n.
-    std::size_t size() const {
-        std::size_t n = 0;
-        for (const auto& _: *this) ++n;
-        return n;
+    size_type size() const { return size_; }
+
+    // Order statistics. Without forest_subtree_size, all are O(n) in the
+    // number of elements n. With it:
+    //
+    // * subtree_size(i) is O(1);
+    // * preorder_rank(i) is O(d+s), where d is the depth of i and s the number
+    //   of preceding siblings of i and of its ancestors;
+    // * nth_preorder(k) is O(d+s), where d and s are as above for the result.
+    //
+    // nth_preorder(k) returns an end iterator if k is not less than size().
+
+    size_type subtree_size(const iterator_base& i) const {
+        return i.n_? count_subtree(i.n_): 0;
+    }
+
+    size_type preorder_rank(const iterator_base& i) const {
+        size_type r = 0;
+        for (node* x = i.n_; x; ) {
+            node* p = parent_of(x);
+            node* s = p? p->child_: first_;
+            for (; s!=x; s = s->next_) r += count_subtree(s);
+            if (p) ++r;
+            x = p;
+        }
+        return r;
     }
 
+    preorder_iterator nth_preorder(size_type k) { return preorder_iterator{iterator_mc<false>{nth_preorder_node(k)}}; }
+    const_preorder_iterator nth_preorder(size_type k) const { return const_preorder_iterator{iterator_mc<true>{nth_preorder_node(k)}}; }
+
     sibling_iterator child_begin(const iterator_mc<false>& i) { return sibling_iterator{i.child()}; }
     const_sibling_iterator child_begin(const iterator_mc<true>& i) const { return const_sibling_iterator{i.child()}; }
 
@@ -147,7 +764,7 @@ public:
     const_sibling_iterator root_end() const { return const_sibling_iterator{}; }
 
     postorder_iterator postorder_begin() { return postorder_iterator{first_leaf()}; }
-    const_postorder_iterator postorder_begin() const { return const_postorder_iterator{first_else_end()}; }
+    const_postorder_iterator postorder_begin() const { return const_postorder_iterator{first_leaf()}; }
 
     postorder_iterator postorder_end() { return {}; }
     const_postorder_iterator postorder_end() const { return {}; }
@@ -172,6 +789,154 @@ public:
     const_iterator cbegin() const { return preorder_begin(); }
     const_iterator cend() const { return {}; }
 
+    // Reverse iteration; requires forest_prev_sibling.
+
+    reverse_sibling_iterator child_rbegin(const iterator_mc<false>& i) { return reverse_sibling_iterator{last_child_of(i)}; }
+    const_reverse_sibling_iterator child_rbegin(const iterator_mc<true>& i) const { return const_reverse_sibling_iterator{last_child_of(i)}; }
+
+    reverse_sibling_iterator child_rend(const iterator_base&) { return {}; }
+    const_reverse_sibling_iterator child_rend(const iterator_base&) const { return {}; }
+
+    reverse_sibling_iterator root_rbegin() { return reverse_sibling_iterator{iterator_mc<false>{last_}}; }
+    const_reverse_sibling_iterator root_rbegin() const { return const_reverse_sibling_iterator{iterator_mc<true>{last_}}; }
+
+    reverse_sibling_iterator root_rend() { return {}; }
+    const_reverse_sibling_iterator root_rend() const { return {}; }
+
+    reverse_preorder_iterator preorder_rbegin() { return reverse_preorder_iterator{iterator_mc<false>{last_preorder_node()}}; }
+    const_reverse_preorder_iterator preorder_rbegin() const { return const_reverse_preorder_iterator{iterator_mc<true>{last_preorder_node()}}; }
+
+    reverse_preorder_iterator preorder_rend() { return {}; }
+    const_reverse_preorder_iterator preorder_rend() const { return {}; }
+
+    reverse_postorder_iterator postorder_rbegin() { return reverse_postorder_iterator{iterator_mc<false>{last_}}; }
+    const_reverse_postorder_iterator postorder_rbegin() const { return const_reverse_postorder_iterator{iterator_mc<true>{last_}}; }
+
+    reverse_postorder_iterator postorder_rend() { return {}; }
+    const_reverse_postorder_iterator postorder_rend() const { return {}; }
+
+    using reverse_iterator = reverse_preorder_iterator;
+    using const_reverse_iterator = const_reverse_preorder_iterator;
+
+    reverse_iterator rbegin() { return preorder_rbegin(); }
+    reverse_iterator rend() { return {}; }
+
+    const_reverse_iterator rbegin() const { return preorder_rbegin(); }
+    const_reverse_iterator rend() const { return {}; }
+
+    const_reverse_iterator crbegin() const { return preorder_rbegin(); }
+    const_reverse_iterator crend() const { return {}; }
+
+    // Depth-tracking iteration over the whole forest, to at most max_depth.
+
+    depth_preorder_iterator depth_preorder_begin(size_type max_depth = no_depth_limit) { return depth_preorder_iterator{first_else_end(), 0, max_depth}; }
+    const_depth_preorder_iterator depth_preorder_begin(size_type max_depth = no_depth_limit) const { return const_depth_preorder_iterator{first_else_end(), 0, max_depth}; }
+
+    depth_preorder_iterator depth_preorder_end() { return {}; }
+    const_depth_preorder_iterator depth_preorder_end() const { return {}; }
+
+    depth_postorder_iterator depth_postorder_begin(size_type max_depth = no_depth_limit) { return depth_postorder_iterator{first_else_end(), 0, max_depth}; }
+    const_depth_postorder_iterator depth_postorder_begin(size_type max_depth = no_depth_limit) const { return const_depth_postorder_iterator{first_else_end(), 0, max_depth}; }
+
+    depth_postorder_iterator depth_postorder_end() { return {}; }
+    const_depth_postorder_iterator depth_postorder_end() const { return {}; }
+
+    // Level-order iteration over the whole forest, using the given frontier.
+
+    levelorder_iterator levelorder_begin(levelorder_frontier& fr) { return levelorder_iterator(fr.start(first_), fr); }
+    const_levelorder_iterator levelorder_begin(levelorder_frontier& fr) const { return const_levelorder_iterator(fr.start(first_), fr); }
+
+    levelorder_iterator levelorder_end() { return {}; }
+    const_levelorder_iterator levelorder_end() const { return {}; }
+
+    // Euler tour of the whole forest, or of the subtree rooted at i.
+
+    euler_iterator euler_begin() { return euler_iterator{first_else_end()}; }
+    const_euler_iterator euler_begin() const { return const_euler_iterator{first_else_end()}; }
+
+    euler_iterator euler_end() { return {}; }
+    const_euler_iterator euler_end() const { return {}; }
+
+    euler_iterator euler_begin(const iterator_mc<false>& i) { return euler_iterator{i}; }
+    const_euler_iterator euler_begin(const iterator_mc<true>& i) const { return const_euler_iterator{i}; }
+
+    euler_iterator euler_end(const iterator_mc<false>& i) { return ++euler_iterator{i, true}; }
+    const_euler_iterator euler_end(const iterator_mc<true>& i) const { return ++const_euler_iterator{i, true}; }
+
+    // Leaves of the whole forest, or of the subtree rooted at i.
+
+    leaf_iterator leaf_begin() { return leaf_iterator{first_leaf()}; }
+    const_leaf_iterator leaf_begin() const { return const_leaf_iterator{first_leaf()}; }
+
+    leaf_iterator leaf_end() { return {}; }
+    const_leaf_iterator leaf_end() const { return {}; }
+
+    leaf_iterator leaf_begin(const iterator_mc<false>& i) { return leaf_iterator{first_leaf_below(i)}; }
+    const_leaf_iterator leaf_begin(const iterator_mc<true>& i) const { return const_leaf_iterator{first_leaf_below(i)}; }
+
+    leaf_iterator leaf_end(const iterator_mc<false>& i) { return leaf_iterator{first_leaf_below(i.preorder_skip())}; }
+    const_leaf_iterator leaf_end(const iterator_mc<true>& i) const { return const_leaf_iterator{first_leaf_below(i.preorder_skip())}; }
+
+    // Proper ancestors of i, from its parent to its root. (An ancestor_iterator
+    // constructed from i itself includes i.)
+
+    ancestor_iterator ancestor_begin(const iterator_mc<false>& i) { return ancestor_iterator{i.parent()}; }
+    const_ancestor_iterator ancestor_begin(const iterator_mc<true>& i) const { return const_ancestor_iterator{i.parent()}; }
+
+    ancestor_iterator ancestor_end(const iterator_base&) { return {}; }
+    const_ancestor_iterator ancestor_end(const iterator_base&) const { return {}; }
+
+    iterator_range<ancestor_iterator> ancestors(const iterator_mc<false>& i) { return {ancestor_begin(i), {}}; }
+    iterator_range<const_ancestor_iterator> ancestors(const iterator_mc<true>& i) const { return {ancestor_begin(i), {}}; }
+
+    // Prefetching iteration over the whole forest, using the given window.
+
+    prefetch_preorder_iterator prefetch_preorder_begin(prefetch_window& w) { return prefetch_preorder_iterator(w.start(first_, first_), w); }
+    const_prefetch_preorder_iterator prefetch_preorder_begin(prefetch_window& w) const { return const_prefetch_preorder_iterator(w.start(first_, first_), w); }
+
+    prefetch_preorder_iterator prefetch_preorder_end() { return {}; }
+    const_prefetch_preorder_iterator prefetch_preorder_end() const { return {}; }
+
+    prefetch_postorder_iterator prefetch_postorder_begin(prefetch_window& w) { return prefetch_postorder_iterator(w.start(first_, first_leaf_node()), w); }
+    const_prefetch_postorder_iterator prefetch_postorder_begin(prefetch_window& w) const { return const_prefetch_postorder_iterator(w.start(first_, first_leaf_node()), w); }
+
+    prefetch_postorder_iterator prefetch_postorder_end() { return {}; }
+    const_prefetch_postorder_iterator prefetch_postorder_end() const { return {}; }
+
+    // Iteration over the subtree rooted at i, in preorder or postorder. The end
+    // iterator is the node that follows the subtree, found once in O(depth), so
+    // each step is no dearer than in iteration over the whole forest.
+
+    preorder_iterator subtree_begin(const iterator_mc<false>& i) { return preorder_iterator{i}; }
+    const_preorder_iterator subtree_begin(const iterator_mc<true>& i) const { return const_preorder_iterator{i}; }
+
+    preorder_iterator subtree_end(const iterator_mc<false>& i) { return preorder_iterator{i.preorder_skip()}; }
+    const_preorder_iterator subtree_end(const iterator_mc<true>& i) const { return const_preorder_iterator{i.preorder_skip()}; }
+
+    postorder_iterator subtree_postorder_begin(const iterator_mc<false>& i) { return postorder_iterator{first_leaf_below(i)}; }
+    const_postorder_iterator subtree_postorder_begin(const iterator_mc<true>& i) const { return const_postorder_iterator{first_leaf_below(i)}; }
+
+    postorder_iterator subtree_postorder_end(const iterator_mc<false>& i) { return postorder_iterator{i.postorder_next()}; }
+    const_postorder_iterator subtree_postorder_end(const iterator_mc<true>& i) const { return const_postorder_iterator{i.postorder_next()}; }
+
+    // Preorder visit of the whole forest, or of the subtree rooted at i. The
+    // visitor is called with a preorder iterator to each node, and returns
+    // forest_descend to continue, forest_prune to skip the node's descendants,
+    // or forest_stop to finish. Returns an iterator to the node at which the
+    // visit stopped, or the end of the range.
+
+    template <typename Visitor>
+    iterator visit(Visitor&& visitor) { return visit_impl(begin(), end(), visitor); }
+
+    template <typename Visitor>
+    const_iterator visit(Visitor&& visitor) const { return visit_impl(begin(), end(), visitor); }
+
+    template <typename Visitor>
+    iterator visit(const iterator_mc<false>& i, Visitor&& visitor) { return visit_impl(subtree_begin(i), subtree_end(i), visitor); }
+
+    template <typename Visitor>
+    const_iterator visit(const iterator_mc<true>& i, Visitor&& visitor) const { return visit_impl(subtree_begin(i), subtree_end(i), visitor); }
+
     // Insertion and emplace operations:
     //
     // * All return an iterator to the last inserted node, or the an iterator to the referenced
@@ -185,17 +950,17 @@ public:
 
     template <typename Iter, typename = std::enable_if_t<std::is_base_of<iterator_mc<false>, Iter>::value>>
     Iter insert_after(const Iter& i, const V& item) {
-        return assert_valid(i), splice_impl(i.n_->parent_, i.n_->next_, make_node(item));
+        return assert_valid(i), splice_node(parent_hint(i.n_), i.n_, make_node(item));
     }
 
     template <typename Iter, typename = std::enable_if_t<std::is_base_of<iterator_mc<false>, Iter>::value>>
     Iter insert_after(const Iter& i, V&& item) {
-        return assert_valid(i), splice_impl(i.n_->parent_, i.n_->next_, make_node(std::move(item)));
+        return assert_valid(i), splice_node(parent_hint(i.n_), i.n_, make_node(std::move(item)));
     }
 
     template <typename Iter, typename... Args, typename = std::enable_if_t<std::is_base_of<iterator_mc<false>, Iter>::value>>
     Iter emplace_after(const Iter& i, Args&&... args) {
-        return assert_valid(i), splice_impl(i.n_->parent_, i.n_->next_, make_node(std::forward<Args>(args)...));
+        return assert_valid(i), splice_node(parent_hint(i.n_), i.n_, make_node(std::forward<Args>(args)...));
     }
 
     // Insert trees in forest as next siblings.
@@ -205,28 +970,26 @@ public:
         assert_valid(i);
         if (of.empty()) return i;
 
-        // Underlying move or copy depends upon allocator equality.
-        ordered_forest f(std::move(of), get_allocator());
-        node* sp_first = f.first_;
-        f.first_ = nullptr;
-        return splice_impl(i.n_->parent_, i.n_->next_, sp_first);
+        size_type n = of.size();
+        auto sp = take_nodes(std::move(of));
+        return splice_impl(parent_hint(i.n_), i.n_, sp.first, sp.second, n);
     }
 
     // Insert item as first child.
 
     template <typename Iter, typename = std::enable_if_t<std::is_base_of<iterator_mc<false>, Iter>::value>>
     Iter push_child(const Iter& i, const V& item) {
-        return assert_valid(i), splice_impl(i.n_, i.n_->child_, make_node(item));
+        return assert_valid(i), splice_node(i.n_, nullptr, make_node(item));
     }
 
     template <typename Iter, typename = std::enable_if_t<std::is_base_of<iterator_mc<false>, Iter>::value>>
     Iter push_child(const Iter& i, V&& item) {
-        return assert_valid(i), splice_impl(i.n_, i.n_->child_, make_node(std::move(item)));
+        return assert_valid(i), splice_node(i.n_, nullptr, make_node(std::move(item)));
     }
 
     template <typename Iter, typename... Args, typename = std::enable_if_t<std::is_base_of<iterator_mc<false>, Iter>::value>>
     Iter emplace_child(const Iter& i, Args&&... args) {
-        return assert_valid(i), splice_impl(i.n_, i.n_->child_, make_node(std::forward<Args>(args)...));
+        return assert_valid(i), splice_node(i.n_, nullptr, make_node(std::forward<Args>(args)...));
     }
 
     // Insert trees in forest as first children.
@@ -236,26 +999,42 @@ public:
         assert_valid(i);
         if (of.empty()) return i;
 
-        // Underlying move or copy depends upon allocator equality.
-        ordered_forest f(std::move(of), get_allocator());
-        node* sp_first = f.first_;
-        f.first_ = nullptr;
-        return splice_impl(i.n_->parent_, i.n_->child_, sp_first);
+        size_type n = of.size();
+        auto sp = take_nodes(std::move(of));
+        return splice_impl(i.n_, nullptr, sp.first, sp.second, n);
+    }
+
+    // Insert item as last child. O(1) with forest_last_child, otherwise
+    // linear in the number of children.
+
+    template <typename Iter, typename = std::enable_if_t<std::is_base_of<iterator_mc<false>, Iter>::value>>
+    Iter push_back_child(const Iter& i, const V& item) {
+        return assert_valid(i), splice_node(i.n_, last_child(i.n_, last_child_tag{}), make_node(item));
+    }
+
+    template <typename Iter, typename = std::enable_if_t<std::is_base_of<iterator_mc<false>, Iter>::value>>
+    Iter push_back_child(const Iter& i, V&& item) {
+        return assert_valid(i), splice_node(i.n_, last_child(i.n_, last_child_tag{}), make_node(std::move(item)));
+    }
+
+    template <typename Iter, typename... Args, typename = std::enable_if_t<std::is_base_of<iterator_mc<false>, Iter>::value>>
+    Iter emplace_back_child(const Iter& i, Args&&... args) {
+        return assert_valid(i), splice_node(i.n_, last_child(i.n_, last_child_tag{}), make_node(std::forward<Args>(args)...));
     }
 
     // Insert item as first top-level tree.
 
     iterator push_front(const V& item) {
-        return splice_impl(nullptr, first_, make_node(item));
+        return splice_node(nullptr, nullptr, make_node(item));
     }
 
     iterator push_front(V&& item) {
-        return splice_impl(nullptr, first_, make_node(std::move(item)));
+        return splice_node(nullptr, nullptr, make_node(std::move(item)));
     }
 
     template <typename... Args>
     iterator emplace_front(Args&&... args) {
-        return splice_impl(nullptr, first_, make_node(std::forward<Args>(args)...));
+        return splice_node(nullptr, nullptr, make_node(std::forward<Args>(args)...));
     }
 
     // Insert trees in forest as first top-level children.
@@ -263,53 +1042,345 @@ public:
     iterator graft_front(ordered_forest of) {
         if (of.empty()) return {};
 
-        // Underlying move or copy depends upon allocator equality.
-        ordered_forest f(std::move(of), get_allocator());
-        node* sp_first = f.first_;
-        f.first_ = nullptr;
-        return splice_impl(nullptr, first_, sp_first);
+        size_type n = of.size();
+        auto sp = take_nodes(std::move(of));
+        return splice_impl(nullptr, nullptr, sp.first, sp.second, n);
+    }
+
+    // Insert item as last top-level tree.
+
+    iterator push_back(const V& item) {
+        return splice_node(nullptr, last_, make_node(item));
+    }
+
+    iterator push_back(V&& item) {
+        return splice_node(nullptr, last_, make_node(std::move(item)));
+    }
+
+    template <typename... Args>
+    iterator emplace_back(Args&&... args) {
+        return splice_node(nullptr, last_, make_node(std::forward<Args>(args)...));
     }
 
     // Erase and cut operations:
     //
     // * Erase/pop operations replace a node with all of that node's children.
     // * Prune operations remove a whole subtree, and return it as a new ordered forest.
+    //   A forest pruned from a pooled forest shares its pool, and so is subject to
+    //   the same thread-safety restriction (see forest_node_pool).
+
+    // Erase/cut the node at i. O(1) with forest_prev_sibling (plus O(depth)
+    // with forest_subtree_size); otherwise linear in the number of preceding
+    // siblings.
+
+    void erase(const iterator_mc<false>& i) {
+        assert_valid(i);
+        node* prev = prev_sibling(i.n_);
+        erase_impl(prev? parent_hint(i.n_): parent_of(i.n_), prev);
+    }
+
+    ordered_forest prune(const iterator_mc<false>& i) {
+        assert_valid(i);
+        node* prev = prev_sibling(i.n_);
+        return prune_impl(prev? parent_hint(i.n_): parent_of(i.n_), prev);
+    }
+
+    // Erase/cut the consecutive siblings first to last, as by erase_range() or
+    // prune_range() from the preceding sibling.
+
+    void erase(const iterator_mc<false>& first, const iterator_mc<false>& last) {
+        assert_valid(first), assert_valid(last);
+        node* prev = prev_sibling(first.n_);
+        erase_run(prev? parent_hint(last.n_): parent_of(first.n_), prev, last.n_);
+    }
+
+    ordered_forest prune(const iterator_mc<false>& first, const iterator_mc<false>& last) {
+        assert_valid(first), assert_valid(last);
+        node* prev = prev_sibling(first.n_);
+        return prune_run(prev? parent_hint(last.n_): parent_of(first.n_), prev, last.n_);
+    }
 
     // Erase/cut next sibling.
 
     void erase_after(const iterator_mc<false>& i) {
-        assert_valid(i.next()), erase_impl(i.n_->next_);
+        assert_valid(i.next()), erase_impl(parent_hint(i.n_->next_), i.n_);
     }
 
     ordered_forest prune_after(const iterator_mc<false>& i) {
-        return assert_valid(i.next()), prune_impl(i.n_->next_);
+        return assert_valid(i.next()), prune_impl(parent_hint(i.n_->next_), i.n_);
     }
 
     // Erase/cut first child.
 
     void erase_child(const iterator_mc<false>& i) {
-        assert_valid(i.child()), erase_impl(i.n_->child_);
+        assert_valid(i.child()), erase_impl(i.n_, nullptr);
     }
 
     ordered_forest prune_child(const iterator_mc<false>& i) {
-        return assert_valid(i.child()), prune_impl(i.n_->child_);
+        return assert_valid(i.child()), prune_impl(i.n_, nullptr);
     }
 
     // Erase/cut root of first tree. Precondition: forest is non-empty.
 
     void erase_front() {
-        assert_nonempty(), erase_impl(first_);
+        assert_nonempty(), erase_impl(nullptr, nullptr);
     }
 
     ordered_forest prune_front() {
-        return assert_nonempty(), prune_impl(first_);
+        return assert_nonempty(), prune_impl(nullptr, nullptr);
+    }
+
+    // Erase/cut the consecutive siblings following i up to and including last.
+    // The run is unlinked, and its neighbours relinked, once: beyond that,
+    // erase_range() costs O(1) per node erased plus the lifting of their
+    // children (which are concatenated and relinked once), and prune_range()
+    // O(1) per tree pruned, plus a count of their nodes without
+    // forest_subtree_size. Precondition: last is a following sibling of i.
+
+    void erase_range(const iterator_mc<false>& i, const iterator_mc<false>& last) {
+        assert_valid(i.next()), assert_valid(last), erase_run(parent_hint(last.n_), i.n_, last.n_);
+    }
+
+    ordered_forest prune_range(const iterator_mc<false>& i, const iterator_mc<false>& last) {
+        return assert_valid(i.next()), assert_valid(last), prune_run(parent_hint(last.n_), i.n_, last.n_);
+    }
+
+    // Move operations relink a subtree, or the consecutive siblings first to
+    // last with their subtrees, to a new position in the same forest, without
+    // allocation, copying or moving items. Iterators remain valid.
+    //
+    // * The moved nodes are unlinked as by erase(i): O(1) with
+    //   forest_prev_sibling, otherwise linear in the number of preceding
+    //   siblings. Relinking is as for the corresponding graft operation.
+    // * Throws std::invalid_argument on end iterators, and is otherwise
+    //   exception-free.
+    // * Precondition: the destination does not lie within the moved subtrees,
+    //   and last is first or a following sibling of first.
+
+    // Move as next siblings of i.
+
+    template <typename Iter, typename = std::enable_if_t<std::is_base_of<iterator_mc<false>, Iter>::value>>
+    Iter move_after(const Iter& i, const iterator_mc<false>& src) {
+        return move_after(i, src, src);
     }
 
-    // Access by reference to root of first tree.
+    template <typename Iter, typename = std::enable_if_t<std::is_base_of<iterator_mc<false>, Iter>::value>>
+    Iter move_after(const Iter& i, const iterator_mc<false>& first, const iterator_mc<false>& last) {
+        assert_valid(i), assert_valid(first), assert_valid(last);
+        size_type n = unlink_run(first.n_, last.n_);
+        return splice_impl(parent_hint(i.n_), i.n_, first.n_, last.n_, n);
+    }
+
+    // Move as first children of i.
+
+    template <typename Iter, typename = std::enable_if_t<std::is_base_of<iterator_mc<false>, Iter>::value>>
+    Iter move_child(const Iter& i, const iterator_mc<false>& src) {
+        return move_child(i, src, src);
+    }
+
+    template <typename Iter, typename = std::enable_if_t<std::is_base_of<iterator_mc<false>, Iter>::value>>
+    Iter move_child(const Iter& i, const iterator_mc<false>& first, const iterator_mc<false>& last) {
+        assert_valid(i), assert_valid(first), assert_valid(last);
+        size_type n = unlink_run(first.n_, last.n_);
+        return splice_impl(i.n_, nullptr, first.n_, last.n_, n);
+    }
+
+    // Move as first top-level trees.
+
+    iterator move_front(const iterator_mc<false>& src) {
+        return move_front(src, src);
+    }
+
+    iterator move_front(const iterator_mc<false>& first, const iterator_mc<false>& last) {
+        assert_valid(first), assert_valid(last);
+        size_type n = unlink_run(first.n_, last.n_);
+        return splice_impl(nullptr, nullptr, first.n_, last.n_, n);
+    }
+
+    // Move the consecutive siblings following before_first up to and including
+    // last, with their subtrees, from src to follow dest, as by
+    // graft_after(dest, src.prune_range(before_first, last)), or as by
+    // move_after() if src is this forest. Returns an iterator to the last
+    // node moved.
+
+    template <typename Iter, typename = std::enable_if_t<std::is_base_of<iterator_mc<false>, Iter>::value>>
+    Iter splice_range(const Iter& dest, ordered_forest& src, const iterator_mc<false>& before_first, const iterator_mc<false>& last) {
+        assert_valid(dest);
+        if (&src==this) return move_after(dest, before_first.next(), last);
+        return graft_after(dest, src.prune_range(before_first, last));
+    }
+
+    // Node handles own a subtree unlinked from a forest, and can be inserted
+    // into the same or another forest of this type with equal allocators
+    // without allocation, copying or moving items.
+    //
+    // For pooled forests, the nodes are relinked only if the receiving forest
+    // already uses the pool the handle's nodes came from; otherwise the items
+    // are moved into new nodes from the receiving forest's own pool, and the
+    // handle's nodes are returned to their pool. Inserting a handle never
+    // makes forests share a pool, but a pooled handle, like the forest it came
+    // from, must not be used concurrently with other users of its pool (see
+    // forest_node_pool). To pass subtrees between threads without allocation,
+    // use forests without forest_node_pool.
+
+    struct node_type;
+
+    // Extract the subtree at i, as by prune(i).
+
+    node_type extract(const iterator_mc<false>& i) {
+        return node_type(prune(i));
+    }
+
+    // Extract the node at i alone, first lifting its children into its place
+    // as by erase(i).
+
+    node_type extract_node(const iterator_mc<false>& i) {
+        assert_valid(i);
+        if (i.n_->child_) move_after(i, i.child(), last_child_of(i));
+        return extract(i);
+    }
+
+    // Insert the subtree held by a node handle as next sibling of i, as first
+    // child of i, or as first top-level tree, leaving the handle empty. Returns
+    // an iterator to the inserted root, or as for graft operations if the
+    // handle is empty.
+
+    template <typename Iter, typename = std::enable_if_t<std::is_base_of<iterator_mc<false>, Iter>::value>>
+    Iter insert_after(const Iter& i, node_type&& nh) {
+        assert_valid(i);
+        if (nh.empty()) return i;
+
+        size_type n = nh.size();
+        auto sp = take_handle_nodes(std::move(nh.f_));
+        return splice_impl(parent_hint(i.n_), i.n_, sp.first, sp.second, n);
+    }
+
+    template <typename Iter, typename = std::enable_if_t<std::is_base_of<iterator_mc<false>, Iter>::value>>
+    Iter push_child(const Iter& i, node_type&& nh) {
+        assert_valid(i);
+        if (nh.empty()) return i;
+
+        size_type n = nh.size();
+        auto sp = take_handle_nodes(std::move(nh.f_));
+        return splice_impl(i.n_, nullptr, sp.first, sp.second, n);
+    }
+
+    iterator push_front(node_type&& nh) {
+        if (nh.empty()) return {};
+
+        size_type n = nh.size();
+        auto sp = take_handle_nodes(std::move(nh.f_));
+        return splice_impl(nullptr, nullptr, sp.first, sp.second, n);
+    }
+
+    // Remove all trees. A pooled forest that is the sole user of its pool
+    // discards all its nodes at once, visiting them only to destroy items that
+    // are not trivially destructible.
+
+    void clear() {
+        if (pooled && pool_.use_count()==1) {
+            destroy_items(first_);
+            pool_->reset();
+        }
+        else {
+            delete_node(first_);
+        }
+        first_ = last_ = nullptr;
+        size_ = 0;
+    }
+
+    // Access by reference to root of first or last tree.
 
     V& front() { return *begin(); }
     const V& front() const { return *begin(); }
 
+    V& back() { return *last_->item(); }
+    const V& back() const { return *last_->item(); }
+
+    // Node storage (pooled forests only; otherwise these are no-ops):
+    //
+    // * reserve(n) ensures that at least n further nodes can be created without
+    //   further allocation.
+    //
+    // * shrink_to_fit() returns wholly unused slabs to the allocator. As the pool
+    //   is shared with forests pruned from this one, slabs holding their nodes
+    //   are retained.
+
+    void reserve(size_type n) {
+        if (pooled) pool().reserve(n);
+    }
+
+    void shrink_to_fit() {
+        if (pool_) pool_->trim();
+    }
+
+    // Relocate every node, in preorder sequence, into fresh storage: for pooled
+    // forests a single new slab, otherwise consecutive individual allocations.
+    // Subsequent traversals then stream through memory. Items are moved with
+    // std::move_if_noexcept; if an item copy throws, the forest is unchanged.
+    //
+    // Invalidates all iterators. Returns the number of bytes the pool releases
+    // afterwards, as for shrink_to_fit(); always zero for unpooled forests.
+
+    size_type compact() {
+        if (empty()) return pool_? pool_->trim(): 0;
+        if (pooled) pool().reserve_run(size_);
+
+        node* old_first = first_;
+        node* old_last = last_;
+        node* new_first = nullptr;
+
+        try {
+            node* i = old_first;
+            node* parent = nullptr;
+            node** next_write = &new_first;
+
+            while (i) {
+                node* x = relocate_node(i);
+                x->parent_ = parent;
+                *next_write = x;
+                set_last(parent, x);
+                append_prev(parent? parent->child_: new_first, x, prev_tag{});
+
+                if (i->child_) {
+                    i = i->child_;
+                    parent = x;
+                    next_write = &x->child_;
+                    continue;
+                }
+
+                next_write = &x->next_;
+                complete_subtree(x);
+                while (i && !i->next_) {
+                    i = i->parent_;
+                    if (parent) {
+                        complete_subtree(parent);
+                        next_write = &parent->next_;
+                        parent = parent->parent_;
+                    }
+                }
+                if (i) i = i->next_;
+            }
+        }
+        catch (...) {
+            delete_node(new_first);
+            last_ = old_last;
+            throw;
+        }
+
+        first_ = new_first;
+        thread_forest(first_, thread_tag{});
+        if (pooled && pool_.use_count()==1) {
+            // Every old slab is now unused: skip the free list entirely.
+            destroy_items(old_first);
+            return pool_->release_all_but_run();
+        }
+        else {
+            delete_node(old_first);
+            return pool_? pool_->trim(): 0;
+        }
+    }
+
     // Comparison:
 
     bool operator==(const ordered_forest& other) const {
@@ -337,23 +1408,27 @@ public:
     ordered_forest(ordered_forest&& other) noexcept:
         ordered_forest(std::move(other.item_alloc_))
     {
-        first_ = other.first_;
-        other.first_ = nullptr;
+        first_ = std::exchange(other.first_, nullptr);
+        last_ = std::exchange(other.last_, nullptr);
+        size_ = std::exchange(other.size_, 0);
+        pool_ = std::move(other.pool_);
     }
 
     ordered_forest(ordered_forest&& other, const Allocator& alloc):
         ordered_forest(alloc)
     {
         if (allocators_equal(other)) {
-            first_ = other.first_;
-            other.first_ = nullptr;
+            first_ = std::exchange(other.first_, nullptr);
+            last_ = std::exchange(other.last_, nullptr);
+            size_ = std::exchange(other.size_, 0);
+            pool_ = std::move(other.pool_);
         }
         else {
             copy_impl(other);
         }
     }
 
-    ordered_forest(std::initializer_list<ordered_forest_builder<V, Allocator>> blist, const Allocator& alloc = Allocator{}):
+    ordered_forest(std::initializer_list<ordered_forest_builder<V, Allocator, Features>> blist, const Allocator& alloc = Allocator{}):
         ordered_forest(alloc)
     {
         sibling_iterator j;
@@ -377,13 +1452,14 @@ public:
 
     ordered_forest& operator=(const ordered_forest& other) {
         if (this==&other) return *this;
-        delete_node(first_);
+        clear();
 
         if (item_alloc_traits::propagate_on_container_copy_assignment::value) {
             item_alloc_ = other.item_alloc_;
         }
         if (node_alloc_traits::propagate_on_container_copy_assignment::value) {
             node_alloc_ = other.node_alloc_;
+            pool_.reset();
         }
 
         copy_impl(other);
@@ -392,7 +1468,7 @@ public:
 
     ordered_forest& operator=(ordered_forest&& other) {
         if (this==&other) return *this;
-        delete_node(first_);
+        clear();
 
         if (item_alloc_traits::propagate_on_container_move_assignment::value) {
             item_alloc_ = other.item_alloc_;
@@ -402,8 +1478,10 @@ public:
         }
 
         if (allocators_equal(other)) {
-            first_ = other.first_;
-            other.first_ = nullptr;
+            first_ = std::exchange(other.first_, nullptr);
+            last_ = std::exchange(other.last_, nullptr);
+            size_ = std::exchange(other.size_, 0);
+            pool_ = std::move(other.pool_);
         }
         else {
             copy_impl(other);
@@ -411,7 +1489,68 @@ public:
         return *this;
     }
 
-    ~ordered_forest() { delete_node(first_); }
+    ~ordered_forest() { clear(); }
+
+    // Bulk construction from flat arrays, and export back to them:
+    //
+    // * from_preorder_depths(values, depths) builds a forest whose preorder
+    //   sequence is values, with the depth of each node given by depths.
+    //   Precondition: depths begins with zero (unless empty), and each depth
+    //   is at most one more than the one before.
+    //
+    // * from_parent_indices(values, parents) builds a forest from values in
+    //   any order, where the random-access container parents gives the index
+    //   of each node's parent, or npos for roots; siblings are ordered by
+    //   index. Precondition: parents describes a forest (in particular, has no
+    //   cycles).
+    //
+    // * preorder_depths() and parent_indices() give the depths and the
+    //   preorder indices of parents of the nodes in preorder, so that either
+    //   factory applied to [begin(), end()) and the result reproduces the
+    //   forest.
+    //
+    // Construction is linear in the number of nodes, linking each directly
+    // without validating the arrays; pooled forests reserve storage for all
+    // nodes at once. Values are moved from an rvalue container. Throws
+    // std::invalid_argument if the arrays differ in size.
+
+    static constexpr size_type npos = size_type(-1);
+
+    template <typename Values, typename Depths>
+    static ordered_forest from_preorder_depths(Values&& values, const Depths& depths, const Allocator& alloc = Allocator()) {
+        if (values.size()!=depths.size()) throw std::invalid_argument("array size mismatch");
+
+        ordered_forest f(alloc);
+        f.build_preorder(item_begin(std::forward<Values>(values)), std::begin(depths), depths.size());
+        return f;
+    }
+
+    template <typename Values, typename Parents>
+    static ordered_forest from_parent_indices(Values&& values, const Parents& parents, const Allocator& alloc = Allocator()) {
+        if (values.size()!=parents.size()) throw std::invalid_argument("array size mismatch");
+
+        ordered_forest f(alloc);
+        f.build_indexed(item_begin(std::forward<Values>(values)), std::begin(parents), parents.size());
+        return f;
+    }
+
+    std::vector<size_type> preorder_depths() const {
+        std::vector<size_type> depths;
+        depths.reserve(size_);
+        for (auto i = depth_preorder_begin(); i!=depth_preorder_end(); ++i) depths.push_back(i.depth());
+        return depths;
+    }
+
+    std::vector<size_type> parent_indices() const {
+        std::vector<size_type> parents, open;
+        parents.reserve(size_);
+        for (auto i = depth_preorder_begin(); i!=depth_preorder_end(); ++i) {
+            open.resize(i.depth());
+            parents.push_back(open.empty()? npos: open.back());
+            open.push_back(parents.size()-1);
+        }
+        return parents;
+    }
 
     // Swap
 
@@ -430,6 +1569,9 @@ public:
         }
 
         swap(first_, other.first_);
+        swap(last_, other.last_);
+        swap(size_, other.size_);
+        swap(pool_, other.pool_);
     }
 
     friend void swap(ordered_forest& a, ordered_forest& b) {
@@ -444,17 +1586,104 @@ private:
     Allocator item_alloc_;
     node_alloc_t node_alloc_;
     node* first_ = nullptr;
+    node* last_ = nullptr;
+    size_type size_ = 0;
+    std::shared_ptr<node_pool> pool_;
 
     bool allocators_equal(const ordered_forest& other) const {
         return item_alloc_==other.item_alloc_ && node_alloc_==other.node_alloc_;
     }
 
+    // Nodes can be moved between forests with equal allocators that share a
+    // node pool, or where either has yet to acquire one.
+
+    bool nodes_shareable(const ordered_forest& other) const {
+        return allocators_equal(other) && (!pool_ || !other.pool_ || pool_==other.pool_);
+    }
+
+    node_pool& pool() {
+        if (!pool_) pool_ = std::allocate_shared<node_pool>(node_alloc_, node_alloc_);
+        return *pool_;
+    }
+
+    // Take the trees of other, moving their items into new nodes if the nodes
+    // cannot be shared. Returns the first and last of the trees.
+
+    std::pair<node*, node*> take_nodes(ordered_forest&& other) {
+        if (!nodes_shareable(other)) return move_nodes(std::move(other));
+
+        if (!pool_) pool_ = other.pool_;
+        other.size_ = 0;
+        return {std::exchange(other.first_, nullptr), std::exchange(other.last_, nullptr)};
+    }
+
+    // As take_nodes, for the trees of a node handle: relinked only if they
+    // already belong to this forest's pool (if any), so that no pool is newly
+    // shared.
+
+    std::pair<node*, node*> take_handle_nodes(ordered_forest&& other) {
+        if (!allocators_equal(other) || pool_!=other.pool_) return move_nodes(std::move(other));
+
+        other.size_ = 0;
+        return {std::exchange(other.first_, nullptr), std::exchange(other.last_, nullptr)};
+    }
+
+    // Move the items of other into new nodes, releasing the old ones.
+
+    std::pair<node*, node*> move_nodes(ordered_forest&& other) {
+        ordered_forest f(get_allocator());
+        f.pool_ = pool_;
+        f.copy_impl(std::move(other));
+        other.clear();
+        pool_ = f.pool_;
+        f.size_ = 0;
+        return {std::exchange(f.first_, nullptr), std::exchange(f.last_, nullptr)};
+    }
+
     iterator_mc<false> first_else_end() { return iterator_mc<false>{first_}; }
     iterator_mc<true> first_else_end() const { return iterator_mc<true>{first_}; }
 
+    template <typename Iter, typename Visitor>
+    static Iter visit_impl(Iter i, Iter end, Visitor& visitor) {
+        while (i!=end) {
+            switch (visitor(static_cast<const Iter&>(i))) {
+            case forest_stop:
+                return i;
+            case forest_prune:
+                i.skip_subtree();
+                break;
+            default:
+                ++i;
+            }
+        }
+        return i;
+    }
+
+    template <bool flag>
+    static iterator_mc<flag> first_leaf_below(iterator_mc<flag> i) {
+        while (auto c = i.child()) i = c;
+        return i;
+    }
+
     iterator_mc<false> first_leaf() { return iterator_mc<false>{first_leaf_node()}; }
     iterator_mc<true> first_leaf() const { return iterator_mc<true>{first_leaf_node()}; }
 
+    node* nth_preorder_node(size_type k) const {
+        node* x = first_;
+        while (x && k) {
+            size_type m = count_subtree(x);
+            if (k<m) {
+                --k;
+                x = x->child_;
+            }
+            else {
+                k -= m;
+                x = x->next_;
+            }
+        }
+        return x;
+    }
+
     node* first_leaf_node() const {
         node* n = first_;
         while (n && n->child_) n = n->child_;
@@ -470,99 +1699,924 @@ private:
         if (!first_) throw std::invalid_argument("empty forest");
     }
 
-    ordered_forest prune_impl(node*& next_write) {
+    // Remove the tree following prev, or if prev is null, the first child of
+    // parent, or the first tree if parent is also null.
+
+    ordered_forest prune_impl(node* parent, node* prev) {
+        node*& next_write = link(parent, prev);
         node* r = next_write;
-        next_write = next_write->next_;
+        size_type n = count_subtree(r);
+        shrink_ancestors(parent, n);
+        unlink_prev(parent, prev, r, r, prev_tag{});
+        thread_spine(prev, r, thread_tag{});
+        thread_spine(r, nullptr, thread_tag{});
+
+        next_write = r->next_;
+        if (!next_write) set_last_sibling(parent, prev);
         r->next_ = nullptr;
         r->parent_ = nullptr;
+        size_ -= n;
 
         ordered_forest f(get_allocator());
-        f.first_ = r;
+        f.first_ = f.last_ = r;
+        f.size_ = n;
+        f.pool_ = pool_;
 
-        return std::move(f);
+        return f;
     }
 
-    void erase_impl(node*& next_write) {
-        ordered_forest cut = prune_impl(next_write);
+    // Remove the node at the same position, replacing it with its children.
 
-        node* cut_root = cut.first_;
-        if (cut_root->child_) {
-            splice_impl(next_write->parent_, next_write, cut_root->child_);
+    void erase_impl(node* parent, node* prev) {
+        node*& next_write = link(parent, prev);
+        node* x = next_write;
+        unlink_prev(parent, prev, x, x, prev_tag{});
+        next_write = x->next_;
+        x->next_ = nullptr;
+
+        if (x->child_) {
+            node* c_last = last_child(x, last_child_tag{});
+            splice_impl(parent, prev, std::exchange(x->child_, nullptr), c_last, 0);
+        }
+        else {
+            if (!next_write) set_last_sibling(parent, prev);
+            thread_spine(prev, x, thread_tag{});
         }
 
-        cut_root->child_ = nullptr;
+        --size_;
+        shrink_ancestors(parent, 1);
+        delete_node(x);
+    }
+
+    // Unlink the consecutive siblings first to last, with their subtrees, for
+    // relinking by splice_impl. With forest_subtree_size, their total size is
+    // deducted from size_ and returned, to be restored by splice_impl;
+    // otherwise neither is needed and zero is returned.
+
+    size_type unlink_run(node* first, node* last) {
+        node* prev = prev_sibling(first);
+        return unlink_run(prev? parent_hint(last): parent_of(first), prev, first, last);
     }
 
-    iterator_mc<false> splice_impl(node* parent, node*& next_write, node* sp_first) {
-        node* sp_last = nullptr;
+    size_type unlink_run(node* parent, node* prev, node* first, node* last) {
+        size_type n = run_size(first, last, augmented_tag{});
+        shrink_ancestors(parent, n);
+        size_ -= n;
 
-        for (node* j = sp_first; j; j = j->next_) {
-            j->parent_ = parent;
-            sp_last = j;
+        unlink_prev(parent, prev, first, last, prev_tag{});
+        thread_spine(prev, last, thread_tag{});
+
+        node*& next_write = link(parent, prev);
+        next_write = last->next_;
+        if (!next_write) set_last_sibling(parent, prev);
+        last->next_ = nullptr;
+        return n;
+    }
+
+    // Remove the consecutive siblings following prev (or the first children of
+    // parent, or the first trees) up to and including last, as a new forest.
+
+    ordered_forest prune_run(node* parent, node* prev, node* last) {
+        node* first = link(parent, prev);
+        size_type n = unlink_run(parent, prev, first, last);
+        if (!augmented) {
+            n = run_size(first, last, std::true_type{});
+            size_ -= n;
         }
-        sp_last->next_ = next_write;
+        adopt(nullptr, first, last, lazy_parent_tag{});
+        thread_spine(last, nullptr, thread_tag{});
+
+        ordered_forest f(get_allocator());
+        f.first_ = first;
+        f.last_ = last;
+        f.size_ = n;
+        f.pool_ = pool_;
+
+        return f;
+    }
+
+    // Remove the same run of nodes, replacing them with the concatenation of
+    // their lists of children.
+
+    void erase_run(node* parent, node* prev, node* last) {
+        node* first = link(parent, prev);
+        size_type n = unlink_run(parent, prev, first, last);
+        size_type k = 0;
+        node* c_first = nullptr;
+        node* c_last = nullptr;
+
+        for (node* x = first; x; ++k) {
+            if (node* c = x->child_) {
+                node* c_tail = last_child(x, last_child_tag{});
+                x->child_ = nullptr;
+                if (c_last) join_siblings(c_last, c);
+                else c_first = c;
+                c_last = c_tail;
+            }
+            delete_node(std::exchange(x, std::exchange(x->next_, nullptr)));
+        }
+
+        if (!augmented) size_ -= k;
+        if (c_first) splice_impl(parent, prev, c_first, c_last, augmented? n-k: 0);
+    }
+
+    // Append the sibling list beginning c to that ending t.
+
+    static void join_siblings(node* t, node* c) {
+        t->next_ = c;
+        join_prev(t, c, prev_tag{});
+        thread_join(t, c, thread_tag{});
+    }
+
+    static void join_prev(node* t, node* c, std::true_type) { c->prev_ = t; }
+    static void join_prev(node*, node*, std::false_type) {}
+
+    static void thread_join(node* t, node* c, std::true_type) { set_escape(t, c); }
+    static void thread_join(node*, node*, std::false_type) {}
+
+    static size_type run_size(node* first, node* last, std::true_type) {
+        size_type n = count_subtree(last);
+        for (node* j = first; j!=last; j = j->next_) n += count_subtree(j);
+        return n;
+    }
+    static size_type run_size(node*, node*, std::false_type) { return 0; }
+
+    // Link the sibling list sp_first to sp_last, comprising n nodes in all
+    // (with their descendants), into the forest after prev, or as the first
+    // children of parent if prev is null, or as the first trees if parent is
+    // also null.
+    //
+    // With forest_lazy_parent and without forest_subtree_size, parent is only
+    // consulted if prev is null or is the last sibling, and may otherwise be
+    // null (see parent_hint()); the same holds for prune_impl and erase_impl
+    // if the node removed is not the last sibling.
+
+    iterator_mc<false> splice_impl(node* parent, node* prev, node* sp_first, node* sp_last, size_type n) {
+        node*& next_write = link(parent, prev);
+        size_ += n;
+        grow_ancestors(parent, n);
+        adopt(parent, sp_first, sp_last, lazy_parent_tag{});
+
+        node* succ = next_write;
+        if (!succ) set_last(parent, sp_last);
+        link_prev(parent, prev, succ, sp_first, sp_last, prev_tag{});
+        sp_last->next_ = succ;
         next_write = sp_first;
+        thread_splice(parent, prev, sp_first, sp_last, thread_tag{});
 
         return iterator_mc<false>{sp_last};
     }
 
-    template <typename U, typename OtherAllocator>
-    void copy_impl(const ordered_forest<U, OtherAllocator>& other) {
-        auto copy_children = [&](auto& self, const auto& from, auto& to) -> void {
-            sibling_iterator j;
-            for (auto i = other.child_begin(from); i!=other.child_end(from); ++i) {
-                j = j? insert_after(j, *i): sibling_iterator(push_child(to, *i));
-                self(self, i, j);
+    iterator_mc<false> splice_node(node* parent, node* prev, node* x) {
+        return splice_impl(parent, prev, x, x, 1);
+    }
+
+    // Record parent in the sibling list sp_first to sp_last: in every node, or
+    // with forest_lazy_parent, just the last.
+
+    static void adopt(node* parent, node* sp_first, node* sp_last, std::false_type) {
+        for (node* j = sp_first; j!=sp_last; j = j->next_) j->parent_ = parent;
+        sp_last->parent_ = parent;
+    }
+    static void adopt(node* parent, node*, node* sp_last, std::true_type) { sp_last->parent_ = parent; }
+
+    // Parent of x, found with forest_lazy_parent from the last sibling of x.
+
+    static node* parent_of(node* x) { return parent_of(x, lazy_parent_tag{}); }
+    static node* parent_of(node* x, std::false_type) { return x->parent_; }
+    static node* parent_of(node* x, std::true_type) {
+        while (x->next_) x = x->next_;
+        return x->parent_;
+    }
+
+    // Parent of x for an edit adjacent to x, where it is only required if x is
+    // the last sibling or if subtree sizes are maintained (see splice_impl):
+    // null where it would be costly to find and is not required.
+
+    static node* parent_hint(node* x) {
+        return lazy_parent && !augmented && x->next_? nullptr: parent_of(x);
+    }
+
+    // Make prev (if any) the last child of parent, or the last tree.
+
+    void set_last_sibling(node* parent, node* prev) {
+        set_last(parent, prev);
+        if (prev) prev->parent_ = parent;
+    }
+
+    // The link to the node following prev, or to the first child of parent if
+    // prev is null, or to the first tree if parent is also null.
+
+    node*& link(node* parent, node* prev) {
+        return prev? prev->next_: parent? parent->child_: first_;
+    }
+
+    static node* last_child(node* p, std::true_type) { return p->last_child_; }
+    static node* last_child(node* p, std::false_type) { return last_child_by_prev(p, prev_tag{}); }
+
+    static node* last_child_by_prev(node* p, std::true_type) { return p->child_? p->child_->prev_: nullptr; }
+    static node* last_child_by_prev(node* p, std::false_type) {
+        node* c = p->child_;
+        if (c) while (c->next_) c = c->next_;
+        return c;
+    }
+
+    template <bool flag>
+    static iterator_mc<flag> last_child_of(const iterator_mc<flag>& i) {
+        return iterator_mc<flag>{i.n_? last_child(i.n_, last_child_tag{}): nullptr};
+    }
+
+    node* last_preorder_node() const {
+        node* x = last_;
+        if (x) while (x->child_) x = last_child(x, last_child_tag{});
+        return x;
+    }
+
+    // Previous sibling of x, or null if x is first.
+
+    node* prev_sibling(node* x) const { return prev_sibling(x, prev_tag{}); }
+
+    static node* prev_sibling(node* x, std::true_type) { return x->prev_->next_? x->prev_: nullptr; }
+    node* prev_sibling(node* x, std::false_type) const {
+        node* p = parent_of(x);
+        node* s = p? p->child_: first_;
+        if (s==x) return nullptr;
+        while (s->next_!=x) s = s->next_;
+        return s;
+    }
+
+    // Maintenance of prev_ links, with the first sibling's prev_ pointing to the
+    // last sibling:
+    //
+    // * link_prev(parent, prev, succ, sp_first, sp_last) is called before the
+    //   sibling list sp_first to sp_last, whose own prev_ links are in place, is
+    //   linked in between prev and succ (either of which may be null);
+    // * unlink_prev(parent, prev, first, last) is called before the siblings
+    //   first to last are unlinked from the list, where prev precedes first; the
+    //   removed run is left with consistent prev_ links of its own;
+    // * append_prev(head, x) is called after x is linked as the last of the list
+    //   beginning head.
+    //
+    // The first sibling (and so parent) is only consulted when the last sibling
+    // changes other than at the front.
+
+    void link_prev(node* parent, node* prev, node* succ, node* sp_first, node* sp_last, std::true_type) {
+        sp_first->prev_ = prev? prev: succ? succ->prev_: sp_last;
+        if (succ) succ->prev_ = sp_last;
+        else if (prev) link(parent, nullptr)->prev_ = sp_last;
+    }
+    void link_prev(node*, node*, node*, node*, node*, std::false_type) {}
+
+    void unlink_prev(node* parent, node* prev, node* first, node* last, std::true_type) {
+        if (node* succ = last->next_) succ->prev_ = prev? prev: first->prev_;
+        else if (prev) link(parent, nullptr)->prev_ = prev;
+        first->prev_ = last;
+    }
+    void unlink_prev(node*, node*, node*, node*, std::false_type) {}
+
+    static void append_prev(node* head, node* x, std::true_type) {
+        if (head==x) {
+            x->prev_ = x;
+        }
+        else {
+            x->prev_ = head->prev_;
+            head->prev_ = x;
+        }
+    }
+    static void append_prev(node*, node*, std::false_type) {}
+
+    // Maintenance of skip_ escape links, where the escape of x is x->next_, or
+    // the escape of its parent if x is last:
+    //
+    // * thread_spine(x, r) gives x, its last child, their last child and so on
+    //   the escape that r had, once r no longer follows them; the escape of
+    //   every node on that path is the same, so the walk stops early if it is
+    //   already correct;
+    // * thread_splice(...) is called once a sibling list has been linked in after
+    //   prev, whose path now escapes to sp_first, while that of sp_last escapes to
+    //   its new successor;
+    // * thread_forest(first) sets every escape link in a single top-down pass.
+
+    static node* escape(node* x, std::true_type) { return x->skip_; }
+    static node* escape(node* x, std::false_type) {
+        while (x && !x->next_) x = x->parent_;
+        return x? x->next_: nullptr;
+    }
+
+    static node* preorder_next_node(node* x) {
+        return x->child_? x->child_: escape(x, thread_tag{});
+    }
+
+    static node* postorder_next_node(node* x) {
+        if (!x->next_) return x->parent_;
+        x = x->next_;
+        while (x->child_) x = x->child_;
+        return x;
+    }
+
+    // Request the cache lines holding the links and item of x; a no-op where
+    // no prefetch builtin is available.
+
+    static void prefetch_node(node* x) {
+#if defined(__GNUC__) || defined(__clang__)
+        __builtin_prefetch(x);
+        __builtin_prefetch(x->item());
+#else
+        (void)x;
+#endif
+    }
+
+    static void thread_spine(node* x, node* r, std::true_type) {
+        set_escape(x, r? r->skip_: nullptr);
+    }
+    static void thread_spine(node*, node*, std::false_type) {}
+
+    static void set_escape(node* x, node* e) {
+        for (; x && x->skip_!=e; x = last_child(x, last_child_tag{})) x->skip_ = e;
+    }
+
+    static void thread_splice(node* parent, node* prev, node* sp_first, node* sp_last, std::true_type) {
+        set_escape(prev, sp_first);
+        set_escape(sp_last, sp_last->next_? sp_last->next_: parent? parent->skip_: nullptr);
+    }
+    static void thread_splice(node*, node*, node*, node*, std::false_type) {}
+
+    static void thread_forest(node* first, std::true_type) {
+        for (node* r = first; r; r = r->next_) r->skip_ = r->next_;
+        for (node* x = first; x; x = x->child_? x->child_: x->skip_) {
+            for (node* c = x->child_; c; c = c->next_) c->skip_ = c->next_? c->next_: x->skip_;
+        }
+    }
+    static void thread_forest(node*, std::false_type) {}
+
+    void set_last(node* parent, node* x) {
+        if (parent) set_last_child(parent, x, last_child_tag{});
+        else last_ = x;
+    }
+
+    static void set_last_child(node* p, node* x, std::true_type) { p->last_child_ = x; }
+    static void set_last_child(node*, node*, std::false_type) {}
+
+    // Number of nodes in the tree rooted at n.
+
+    static size_type count_subtree(node* n) { return count_subtree(n, augmented_tag{}); }
+
+    static size_type count_subtree(node* n, std::true_type) { return n->subtree_size_; }
+
+    static size_type count_subtree(node* n, std::false_type) {
+        size_type k = 0;
+        for (node* x = n; x; ) {
+            ++k;
+            if (x->child_) {
+                x = x->child_;
+            }
+            else {
+                while (x!=n && !x->next_) x = x->parent_;
+                x = x==n? nullptr: x->next_;
             }
-        };
+        }
+        return k;
+    }
 
-        sibling_iterator j;
-        for (auto i = other.root_begin(); i!=other.root_end(); ++i) {
-            j = j? insert_after(j, *i): sibling_iterator(push_front(*i));
-            copy_children(copy_children, i, j);
+    // Maintain subtree sizes of p and its ancestors.
+
+    static void grow_ancestors(node* p, size_type n) { grow_ancestors(p, n, augmented_tag{}); }
+    static void grow_ancestors(node*, size_type, std::false_type) {}
+    static void grow_ancestors(node* p, size_type n, std::true_type) {
+        for (; p; p = parent_of(p)) p->subtree_size_ += n;
+    }
+
+    static void shrink_ancestors(node* p, size_type n) { shrink_ancestors(p, n, augmented_tag{}); }
+    static void shrink_ancestors(node*, size_type, std::false_type) {}
+    static void shrink_ancestors(node* p, size_type n, std::true_type) {
+        for (; p; p = parent_of(p)) p->subtree_size_ -= n;
+    }
+
+    // When building a tree top-down, add the size of the completed subtree x
+    // to that of its parent.
+
+    static void complete_subtree(node* x) { complete_subtree(x, augmented_tag{}); }
+    static void complete_subtree(node*, std::false_type) {}
+    static void complete_subtree(node* x, std::true_type) {
+        if (x->parent_) x->parent_->subtree_size_ += x->subtree_size_;
+    }
+
+    // Copy the trees of other into this (empty) forest in a single preorder pass,
+    // linking each new node directly, and moving rather than copying items if
+    // other is an rvalue. Partial copies remain well-formed, so that they are
+    // reclaimed if an item copy throws.
+
+    template <typename Other>
+    void copy_impl(Other&& other) {
+        using item_ref = std::conditional_t<std::is_lvalue_reference<Other>::value, const V&, V&&>;
+        if (pooled) reserve(other.size());
+
+        try {
+            auto i = other.root_begin();
+            node* parent = nullptr;
+            node** next_write = &first_;
+
+            while (i) {
+                node* x = make_node(static_cast<item_ref>(*i));
+                x->parent_ = parent;
+                *next_write = x;
+                set_last(parent, x);
+                append_prev(parent? parent->child_: first_, x, prev_tag{});
+                ++size_;
+
+                if (i.child()) {
+                    i = i.child();
+                    parent = x;
+                    next_write = &x->child_;
+                    continue;
+                }
+
+                next_write = &x->next_;
+                complete_subtree(x);
+                while (i && !i.next()) {
+                    i = i.parent();
+                    if (parent) {
+                        complete_subtree(parent);
+                        next_write = &parent->next_;
+                        parent = parent->parent_;
+                    }
+                }
+                if (i) i = i.next();
+            }
+        }
+        catch (...) {
+            thread_forest(first_, thread_tag{});
+            clear();
+            throw;
         }
+        thread_forest(first_, thread_tag{});
     }
 
-    // Node creation, destruction:
+    // Items from a container, moved if it is an rvalue.
+
+    template <typename C>
+    static auto item_begin(C& c) {
+        using std::begin;
+        return begin(c);
+    }
+
+    template <typename C, typename = std::enable_if_t<!std::is_lvalue_reference<C>::value>>
+    static auto item_begin(C&& c) {
+        using std::begin;
+        return std::make_move_iterator(begin(c));
+    }
+
+    // Build this (empty) forest from n items in preorder with their depths, in
+    // a single pass as for copy_impl.
+
+    template <typename ItemIter, typename DepthIter>
+    void build_preorder(ItemIter item, DepthIter depth_iter, size_type n) {
+        if (pooled) reserve(n);
+
+        try {
+            node* x = nullptr;
+            node* parent = nullptr;
+            node** next_write = &first_;
+            size_type depth = 0;
+
+            for (size_type k = 0; k<n; ++k, ++item, ++depth_iter) {
+                size_type d = *depth_iter;
+                if (x && d>depth) {
+                    parent = x;
+                    next_write = &x->child_;
+                }
+                else if (x) {
+                    complete_subtree(x);
+                    for (; depth>d; --depth) {
+                        complete_subtree(parent);
+                        next_write = &parent->next_;
+                        parent = parent->parent_;
+                    }
+                }
+                depth = d;
+
+                x = make_node(*item);
+                x->parent_ = parent;
+                *next_write = x;
+                next_write = &x->next_;
+                set_last(parent, x);
+                append_prev(parent? parent->child_: first_, x, prev_tag{});
+                ++size_;
+            }
+
+            if (x) complete_subtree(x);
+            for (; parent; parent = parent->parent_) complete_subtree(parent);
+        }
+        catch (...) {
+            thread_forest(first_, thread_tag{});
+            clear();
+            throw;
+        }
+        thread_forest(first_, thread_tag{});
+    }
+
+    // Build this (empty) forest from n items with the indices of their
+    // parents: all nodes are made first, then each is pushed as the first
+    // child of its parent in reverse order, and subtree sizes are totalled in
+    // postorder.
+
+    template <typename ItemIter, typename ParentIter>
+    void build_indexed(ItemIter item, ParentIter parent_iter, size_type n) {
+        using node_ptr_alloc_t = typename std::allocator_traits<Allocator>::template rebind_alloc<node*>;
+        std::vector<node*, node_ptr_alloc_t> nodes{node_ptr_alloc_t(item_alloc_)};
+        nodes.reserve(n);
+        if (pooled) reserve(n);
+
+        try {
+            for (size_type k = 0; k<n; ++k, ++item) nodes.push_back(make_node(*item));
+        }
+        catch (...) {
+            for (node* x: nodes) {
+                x->next_ = first_;
+                first_ = x;
+            }
+            thread_forest(first_, thread_tag{});
+            clear();
+            throw;
+        }
+
+        for (size_type k = n; k--; ) {
+            node* x = nodes[k];
+            size_type p = parent_iter[k];
+            node* parent = p==npos? nullptr: nodes[p];
+            node*& head = link(parent, nullptr);
+            if (!head) set_last(parent, x);
+            prepend_prev(head, x, prev_tag{});
+            x->parent_ = parent;
+            x->next_ = head;
+            head = x;
+        }
+        size_ = n;
+
+        total_subtrees(first_, augmented_tag{});
+        thread_forest(first_, thread_tag{});
+    }
+
+    static void prepend_prev(node* head, node* x, std::true_type) {
+        if (head) {
+            x->prev_ = head->prev_;
+            head->prev_ = x;
+        }
+        else {
+            x->prev_ = x;
+        }
+    }
+    static void prepend_prev(node*, node*, std::false_type) {}
+
+    // Total the subtree sizes of a forest whose nodes each count only
+    // themselves, with every parent_ link set.
+
+    static void total_subtrees(node* first, std::true_type) {
+        if (!first) return;
+        for (node* x = first_leaf_below(iterator_mc<false>{first}).n_; x; x = postorder_next_node(x)) complete_subtree(x);
+    }
+    static void total_subtrees(node*, std::false_type) {}
+
+    node* allocate_node() {
+        return pooled? pool().allocate(): node_alloc_traits::allocate(node_alloc_, 1);
+    }
+
+    void deallocate_node(node* x) {
+        if (pooled) pool_->deallocate(x);
+        else node_alloc_traits::deallocate(node_alloc_, x, 1);
+    }
 
     template <typename... Args>
     node* make_node(Args&&... args) {
-        node* x = node_alloc_traits::allocate(node_alloc_, 1);
+        node* x = allocate_node();
         try {
             node_alloc_traits::construct(node_alloc_, x);
+            try {
+                item_alloc_traits::construct(item_alloc_, x->item(), std::forward<Args>(args)...);
+            }
+            catch (...) {
+                node_alloc_traits::destroy(node_alloc_, x);
+                throw;
+            }
         }
         catch (...) {
-            node_alloc_traits::deallocate(node_alloc_, x, 1);
+            deallocate_node(x);
             throw;
         }
+        return x;
+    }
 
-        x->item_ = item_alloc_traits::allocate(item_alloc_, 1);
+    // Move the item of i into a new node for compact(), taken from the run
+    // reserved in the pool if pooled.
+
+    node* relocate_node(node* i) {
+        node* x = pooled? pool_->allocate_run(): node_alloc_traits::allocate(node_alloc_, 1);
         try {
-            item_alloc_traits::construct(item_alloc_, x->item_, std::forward<Args>(args)...);
+            node_alloc_traits::construct(node_alloc_, x);
+            try {
+                item_alloc_traits::construct(item_alloc_, x->item(), std::move_if_noexcept(*i->item()));
+            }
+            catch (...) {
+                node_alloc_traits::destroy(node_alloc_, x);
+                throw;
+            }
         }
         catch (...) {
-            item_alloc_traits::deallocate(item_alloc_, x->item_, 1);
+            deallocate_node(x);
             throw;
         }
         return x;
     }
 
+    // Delete n, its subtree, and its following siblings in constant stack space:
+    // a node with children is parked as the next_ of its first child, with its
+    // remaining children in its child_ link, and deleted once they are gone.
+
     void delete_node(node* n) {
-        if (!n) return;
+        while (n) {
+            if (node* c = n->child_) {
+                n->child_ = c->next_;
+                c->next_ = n;
+                n = c;
+            }
+            else {
+                node* next = n->next_;
+                item_alloc_traits::destroy(item_alloc_, n->item());
+                node_alloc_traits::destroy(node_alloc_, n);
+                deallocate_node(n);
+                n = next;
+            }
+        }
+    }
+
+    void destroy_items(node* n) {
+        if (std::is_trivially_destructible<V>::value) return;
+
+        for (iterator_mc<false> i{n}; i; i = i.preorder_next()) {
+            item_alloc_traits::destroy(item_alloc_, i.n_->item());
+        }
+    }
+
+    // Sort an intrusive singly linked list by address.
+
+    template <typename T>
+    static T* sort_by_address(T* head, T* T::* link) {
+        if (!head || !(head->*link)) return head;
+
+        T* slow = head;
+        for (T* fast = head->*link; fast && fast->*link; fast = fast->*link->*link) {
+            slow = slow->*link;
+        }
+        T* tail = slow->*link;
+        slow->*link = nullptr;
+
+        T* a = sort_by_address(head, link);
+        T* b = sort_by_address(tail, link);
+
+        T* merged = nullptr;
+        T** w = &merged;
+        while (a && b) {
+            T*& least = std::less<const T*>{}(a, b)? a: b;
+            *w = least;
+            w = &(least->*link);
+            least = least->*link;
+        }
+        *w = a? a: b;
+        return merged;
+    }
+};
+
+template <typename V, typename Allocator, unsigned Features>
+constexpr typename ordered_forest<V, Allocator, Features>::size_type ordered_forest<V, Allocator, Features>::no_depth_limit;
+
+template <typename V, typename Allocator, unsigned Features>
+constexpr typename ordered_forest<V, Allocator, Features>::size_type ordered_forest<V, Allocator, Features>::default_prefetch_distance;
+
+template <typename V, typename Allocator, unsigned Features>
+constexpr typename ordered_forest<V, Allocator, Features>::size_type ordered_forest<V, Allocator, Features>::npos;
+
+// Node handle holding a subtree extracted from a forest (see extract()).
+
+template <typename V, typename Allocator, unsigned Features>
+struct ordered_forest<V, Allocator, Features>::node_type {
+    node_type() = default;
+    node_type(node_type&&) = default;
+    node_type& operator=(node_type&&) = default;
+
+    bool empty() const noexcept { return f_.empty(); }
+    explicit operator bool() const noexcept { return !f_.empty(); }
+
+    // Item at the root of the held subtree. Precondition: non-empty.
+    V& value() const { return *f_.first_->item(); }
+
+    // Number of nodes in the held subtree.
+    size_type size() const { return f_.size(); }
+
+    allocator_type get_allocator() const { return f_.get_allocator(); }
+
+    void swap(node_type& other) { f_.swap(other.f_); }
+    friend void swap(node_type& a, node_type& b) { a.swap(b); }
+
+private:
+    friend ordered_forest;
+    explicit node_type(ordered_forest f): f_(std::move(f)) {}
+
+    ordered_forest f_;
+};
+
+// Slab storage for nodes. Slabs grow geometrically up to max_slab nodes, each
+// preceded by a header occupying one node's worth of storage; freed nodes are
+// threaded through their next_ links.
 
-        delete_item(n->item_);
-        delete_node(n->child_);
-        delete_node(n->next_);
+template <typename V, typename Allocator, unsigned Features>
+struct ordered_forest<V, Allocator, Features>::node_pool {
+    explicit node_pool(const node_alloc_t& alloc): alloc_(alloc) {}
 
-        node_alloc_traits::destroy(node_alloc_, n);
-        node_alloc_traits::deallocate(node_alloc_, n, 1);
+    node_pool(const node_pool&) = delete;
+    node_pool& operator=(const node_pool&) = delete;
+
+    ~node_pool() {
+        while (slabs_) release_slab(std::exchange(slabs_, slabs_->next_));
+        while (spare_) release_slab(std::exchange(spare_, spare_->next_));
+    }
+
+    node* allocate() {
+        if (free_) {
+            --n_free_;
+            return std::exchange(free_, free_->next_);
+        }
+        if (bump_==bump_end_) {
+            if (spare_) use_spare();
+            else grow(1);
+        }
+        return bump_++;
+    }
+
+    void deallocate(node* x) {
+        x->next_ = free_;
+        free_ = x;
+        ++n_free_;
+    }
+
+    void reserve(size_type n) {
+        size_type avail = n_free_+n_spare_+(bump_end_-bump_);
+        if (n>avail) grow(n-avail);
+    }
+
+    // Start a new slab of exactly n nodes, to be handed out in address order by
+    // allocate_run(), bypassing the free list.
+
+    void reserve_run(size_type n) {
+        bump_from(make_slab(n));
+    }
+
+    node* allocate_run() {
+        return bump_++;
     }
 
-    void delete_item(V* item) {
-        if (!item) return;
+    // Release every slab but the run, and all spares, without visiting any
+    // nodes; returns the number of bytes released. Only valid when no forest
+    // holds nodes outside the run.
+
+    size_type release_all_but_run() {
+        slab* run = std::exchange(slabs_, slabs_->next_);
+        reset();
+        size_type released = trim();
+
+        run->next_ = nullptr;
+        slabs_ = run;
+        return released;
+    }
+
+    // Return every slab to the spare list without visiting any nodes. Only valid
+    // when no forest holds nodes from this pool.
+
+    void reset() {
+        while (slabs_) {
+            slab* s = std::exchange(slabs_, slabs_->next_);
+            s->next_ = spare_;
+            spare_ = s;
+            n_spare_ += s->n_;
+        }
+        free_ = nullptr;
+        n_free_ = 0;
+        bump_ = bump_end_ = nullptr;
+    }
+
+    // Release every slab with no live nodes; returns the number of bytes released.
+    // Sorting the free list by address also means subsequent allocations are
+    // handed out in address order.
+
+    size_type trim() {
+        retire_bump();
+        free_ = sort_by_address(free_, &node::next_);
+        slabs_ = sort_by_address(slabs_, &slab::next_);
+
+        std::less<const node*> lt;
+        size_type released = 0;
+        node* f = free_;
+        node** free_w = &free_;
+        slab** slab_w = &slabs_;
+
+        for (slab* s = slabs_; s; ) {
+            slab* next = s->next_;
+            node* run_first = f;
+            node* run_last = nullptr;
+            size_type count = 0;
+
+            for (; f && !lt(f, s->begin()) && lt(f, s->end()); f = f->next_) {
+                run_last = f;
+                ++count;
+            }
+
+            if (count==s->n_) {
+                n_free_ -= count;
+                released += (s->n_+1)*sizeof(node);
+                release_slab(s);
+            }
+            else {
+                if (count) {
+                    *free_w = run_first;
+                    free_w = &run_last->next_;
+                }
+                *slab_w = s;
+                slab_w = &s->next_;
+            }
+            s = next;
+        }
+
+        *free_w = nullptr;
+        *slab_w = nullptr;
+
+        while (spare_) {
+            released += (spare_->n_+1)*sizeof(node);
+            release_slab(std::exchange(spare_, spare_->next_));
+        }
+        n_spare_ = 0;
+        return released;
+    }
+
+private:
+    struct slab {
+        slab* next_;
+        size_type n_;
+
+        node* begin() { return reinterpret_cast<node*>(this)+1; }
+        node* end() { return begin()+n_; }
+    };
+
+    static_assert(sizeof(slab)<=sizeof(node) && alignof(slab)<=alignof(node), "slab header must fit in a node");
+
+    static constexpr size_type min_slab = 64;
+    static constexpr size_type max_slab = 1<<16;
+
+    node_alloc_t alloc_;
+    slab* slabs_ = nullptr;
+    size_type capacity_ = 0;
+
+    // Unused slabs, retained after a reset.
+    slab* spare_ = nullptr;
+    size_type n_spare_ = 0;
+
+    node* free_ = nullptr;
+    size_type n_free_ = 0;
+
+    node* bump_ = nullptr;
+    node* bump_end_ = nullptr;
+
+    void grow(size_type n) {
+        size_type k = capacity_<min_slab? min_slab: capacity_>max_slab? max_slab: capacity_;
+        bump_from(make_slab(std::max(n, k)));
+    }
+
+    slab* make_slab(size_type n) {
+        node* p = node_alloc_traits::allocate(alloc_, n+1);
+        capacity_ += n;
+        return ::new (static_cast<void*>(p)) slab{nullptr, n};
+    }
+
+    void use_spare() {
+        slab* s = std::exchange(spare_, spare_->next_);
+        n_spare_ -= s->n_;
+        bump_from(s);
+    }
+
+    void bump_from(slab* s) {
+        retire_bump();
+        s->next_ = slabs_;
+        slabs_ = s;
+        bump_ = s->begin();
+        bump_end_ = s->end();
+    }
+
+    void retire_bump() {
+        while (bump_!=bump_end_) deallocate(bump_++);
+    }
 
-        item_alloc_traits::destroy(item_alloc_, item);
-        item_alloc_traits::deallocate(item_alloc_, item, 1);
+    void release_slab(slab* s) {
+        if (bump_==s->end()) bump_ = bump_end_ = nullptr;
+        capacity_ -= s->n_;
+        node_alloc_traits::deallocate(alloc_, reinterpret_cast<node*>(s), s->n_+1);
     }
 };
 
@@ -574,7 +2628,7 @@ private:
 // While the builder takes the same allocator type as its associated forest, it
 // will build the temporary trees with a default-constructed allocator.
 
-template <typename V, typename Allocator>
+template <typename V, typename Allocator, unsigned Features>
 struct ordered_forest_builder {
     template <typename X, typename std::enable_if_t<std::is_constructible<V, X&&>::value, int> = 0>
     ordered_forest_builder(X&& x) {
@@ -582,22 +2636,22 @@ struct ordered_forest_builder {
     }
 
     template <typename X, typename std::enable_if_t<std::is_constructible<V, X&&>::value, int> = 0>
-    ordered_forest_builder(X&& x, std::initializer_list<ordered_forest_builder<V, Allocator>> children) {
-        using sibling_iterator = typename ordered_forest<V, Allocator>::sibling_iterator;
+    ordered_forest_builder(X&& x, std::initializer_list<ordered_forest_builder<V, Allocator, Features>> children) {
+        using sibling_iterator = typename ordered_forest<V, Allocator, Features>::sibling_iterator;
 
         auto top = f_.emplace_front(x);
         sibling_iterator j;
 
         for (auto& g: children) {
-            ordered_forest<V, Allocator> c(std::move(g.f_));
+            ordered_forest<V, Allocator, Features> c(std::move(g.f_));
             j = j? f_.graft_after(j, std::move(c)): sibling_iterator(f_.graft_child(top, std::move(c)));
         }
     }
 
-    friend class ordered_forest<V, Allocator>;
+    friend class ordered_forest<V, Allocator, Features>;
 
 private:
-    ordered_forest<V, Allocator> f_;
+    ordered_forest<V, Allocator, Features> f_;
 };
 
 #endif // ndef ORDERED_FOREST_H_
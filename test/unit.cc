@@ -1,11 +1,15 @@
+#include <algorithm>
 #include <cstddef>
 #include <memory>
+#include <string>
 #include <type_traits>
 #include <vector>
 
 #define CATCH_CONFIG_MAIN
 #include "catch.hpp"
 
+#include "compact_forest.h"
+#include "indexed_forest.h"
 #include "ordered_forest.h"
 
 template <typename T>
@@ -26,13 +30,13 @@ struct simple_allocator {
     }
 
     T* allocate(std::size_t n) {
-        auto p = new T[n];
+        auto p = static_cast<T*>(::operator new(n*sizeof(T)));
         ++*n_alloc_;
         return p;
     }
 
     void deallocate(T* p, std::size_t) {
-        delete [] p;
+        ::operator delete(p);
         ++*n_dealloc_;
     }
 
@@ -59,6 +63,61 @@ struct simple_allocator {
     std::shared_ptr<std::size_t> n_alloc_, n_dealloc_;
 };
 
+// Forest types used for tests that are parameterized over optional features.
+
+using plain_forest = ordered_forest<int>;
+using pooled_forest = ordered_forest<int, std::allocator<int>, forest_node_pool>;
+using sized_forest = ordered_forest<int, std::allocator<int>, forest_subtree_size>;
+using sized_pooled_forest = ordered_forest<int, std::allocator<int>, forest_subtree_size|forest_node_pool>;
+using tailed_forest = ordered_forest<int, std::allocator<int>, forest_last_child>;
+using tailed_sized_forest = ordered_forest<int, std::allocator<int>, forest_last_child|forest_subtree_size>;
+
+using linked_forest = ordered_forest<int, std::allocator<int>, forest_prev_sibling>;
+using linked_full_forest = ordered_forest<int, std::allocator<int>, forest_prev_sibling|forest_last_child|forest_subtree_size|forest_node_pool>;
+
+using threaded_forest = ordered_forest<int, std::allocator<int>, forest_preorder_thread>;
+using threaded_linked_forest = ordered_forest<int, std::allocator<int>, forest_preorder_thread|forest_prev_sibling>;
+using threaded_sized_pooled_forest = ordered_forest<int, std::allocator<int>, forest_preorder_thread|forest_subtree_size|forest_node_pool>;
+
+using lazy_forest = ordered_forest<int, std::allocator<int>, forest_lazy_parent>;
+using lazy_tailed_pooled_forest = ordered_forest<int, std::allocator<int>, forest_lazy_parent|forest_last_child|forest_node_pool>;
+using lazy_full_forest = ordered_forest<int, std::allocator<int>, forest_lazy_parent|forest_prev_sibling|forest_preorder_thread|forest_subtree_size>;
+
+#define ALL_FOREST_TYPES plain_forest, pooled_forest, sized_forest, sized_pooled_forest, tailed_forest, tailed_sized_forest, linked_forest, linked_full_forest, \
+    threaded_forest, threaded_linked_forest, threaded_sized_pooled_forest, lazy_forest, lazy_tailed_pooled_forest, lazy_full_forest
+#define LINKED_FOREST_TYPES linked_forest, linked_full_forest, lazy_full_forest
+#define THREADED_FOREST_TYPES threaded_forest, threaded_linked_forest, threaded_sized_pooled_forest, lazy_full_forest
+#define LAZY_FOREST_TYPES lazy_forest, lazy_tailed_pooled_forest, lazy_full_forest
+
+// Find the first node holding x in preorder.
+
+template <typename Forest>
+typename Forest::iterator find_value(Forest& f, int x) {
+    return std::find(f.begin(), f.end(), x);
+}
+
+// Check size(), subtree_size(), preorder_rank() and nth_preorder() against
+// a preorder traversal.
+
+template <typename Forest>
+void check_order_statistics(const Forest& f) {
+    std::size_t k = 0;
+    for (auto i = f.begin(); i!=f.end(); ++i, ++k) {
+        CHECK(f.preorder_rank(i) == k);
+        CHECK(f.nth_preorder(k) == i);
+
+        std::size_t n = 1;
+        for (auto j = std::next(i); j!=f.end(); ++j, ++n) {
+            auto a = j.parent();
+            while (a && a!=i) a = a.parent();
+            if (!a) break;
+        }
+        CHECK(f.subtree_size(i) == n);
+    }
+    CHECK(f.size() == k);
+    CHECK(f.nth_preorder(k) == f.end());
+}
+
 TEST_CASE("empty") {
     ordered_forest<int> f1;
     CHECK(f1.size() == 0);
@@ -86,7 +145,7 @@ TEST_CASE("push") {
         f.push_front(1);
 
         REQUIRE(f.size() == 5);
-        CHECK(alloc.n_alloc() == 10); // five nodes, five items.
+        CHECK(alloc.n_alloc() == 5); // five nodes, items stored inline.
 
         auto i = f.begin();
         REQUIRE((bool)i);
@@ -127,7 +186,7 @@ TEST_CASE("insert") {
         f.insert_after(c, 5);
 
         REQUIRE(f.size() == 6);
-        CHECK(alloc.n_alloc() == 12); // six nodes, six items.
+        CHECK(alloc.n_alloc() == 6); // six nodes, items stored inline.
 
         auto i = f.begin();
         REQUIRE((bool)i);
@@ -232,6 +291,10 @@ TEST_CASE("iteration") {
     ivector post{f.postorder_begin(), f.postorder_end()};
     CHECK(post == ivector{2, 3, 1, 5, 7, 6, 8, 4, 9});
 
+    const auto& cf = f;
+    ivector cpost{cf.postorder_begin(), cf.postorder_end()};
+    CHECK(cpost == ivector{2, 3, 1, 5, 7, 6, 8, 4, 9});
+
     auto four = std::find(f.begin(), f.end(), 4);
     ivector child_four{f.child_begin(four), f.child_end(four)};
     CHECK(child_four == ivector{5, 6, 8});
@@ -248,6 +311,1003 @@ TEST_CASE("iteration") {
     CHECK(post_seven_nine == ivector{7, 6, 8, 4});
 }
 
+// Check subtree iteration against whole-forest iteration filtered by ancestry.
+
+template <typename Forest>
+void check_subtree_iteration(Forest& f) {
+    using ivector = std::vector<int>;
+
+    auto within = [](auto j, auto i) {
+        while (j && j!=i) j = j.parent();
+        return j==i;
+    };
+
+    for (auto i = f.begin(); i!=f.end(); ++i) {
+        ivector pre, post;
+        for (auto j = f.preorder_begin(); j!=f.preorder_end(); ++j) if (within(j, i)) pre.push_back(*j);
+        for (auto j = f.postorder_begin(); j!=f.postorder_end(); ++j) if (within(j, i)) post.push_back(*j);
+
+        CHECK(ivector(f.subtree_begin(i), f.subtree_end(i)) == pre);
+        CHECK(ivector(f.subtree_postorder_begin(i), f.subtree_postorder_end(i)) == post);
+
+        const Forest& cf = f;
+        CHECK(ivector(cf.subtree_begin(i), cf.subtree_end(i)) == pre);
+        CHECK(ivector(cf.subtree_postorder_begin(i), cf.subtree_postorder_end(i)) == post);
+    }
+}
+
+TEMPLATE_TEST_CASE("subtree iteration", "", ALL_FOREST_TYPES) {
+    TestType f = {{1, {2, 3}}, {4, {5, {6, {7}}, 8}}, 9};
+
+    auto four = std::find(f.begin(), f.end(), 4);
+    CHECK(std::vector<int>(f.subtree_begin(four), f.subtree_end(four)) == (std::vector<int>{4, 5, 6, 7, 8}));
+    CHECK(*f.subtree_end(four) == 9);
+    CHECK(std::vector<int>(f.subtree_postorder_begin(four), f.subtree_postorder_end(four)) == (std::vector<int>{5, 7, 6, 8, 4}));
+
+    check_subtree_iteration(f);
+    CHECK(f.subtree_begin(f.end()) == f.subtree_end(f.end()));
+}
+
+// Check skip_subtree() and visit() against filtered whole-forest iteration.
+
+template <typename Forest>
+void check_pruned_visit(Forest& f) {
+    using ivector = std::vector<int>;
+
+    // Prune below odd items.
+    ivector expected;
+    for (auto i = f.begin(); i!=f.end(); ++i) {
+        bool hidden = false;
+        for (auto a = i.parent(); a; a = a.parent()) hidden |= *a%2==1;
+        if (!hidden) expected.push_back(*i);
+    }
+
+    ivector skipped;
+    for (auto i = f.begin(); i!=f.end(); ) {
+        skipped.push_back(*i);
+        if (*i%2) i.skip_subtree();
+        else ++i;
+    }
+    CHECK(skipped == expected);
+
+    ivector visited;
+    auto end = f.visit([&](auto i) { visited.push_back(*i); return *i%2? forest_prune: forest_descend; });
+    CHECK(visited == expected);
+    CHECK(end == f.end());
+
+    const Forest& cf = f;
+    visited.clear();
+    auto stop = cf.visit([&](auto i) { visited.push_back(*i); return *i==expected.back()? forest_stop: *i%2? forest_prune: forest_descend; });
+    CHECK(visited == expected);
+    REQUIRE(stop);
+    CHECK(*stop == expected.back());
+
+    // Bounded to a subtree, pruning at its root.
+    for (auto i = f.begin(); i!=f.end(); ++i) {
+        visited.clear();
+        auto e = f.visit(i, [&](auto j) { visited.push_back(*j); return forest_prune; });
+        CHECK(visited == ivector{*i});
+        CHECK(e == f.subtree_end(i));
+    }
+}
+
+TEMPLATE_TEST_CASE("skip_subtree and visit", "", ALL_FOREST_TYPES) {
+    TestType f = {{2, {1, {3, {4}}}}, {4, {5, {6, {7, {9}}}, 8}}, 10};
+    check_pruned_visit(f);
+
+    auto six = std::find(f.begin(), f.end(), 6);
+    std::vector<int> visited;
+    auto e = f.visit(f.begin().next(), [&](auto i) {
+        visited.push_back(*i);
+        return i==six? forest_prune: forest_descend;
+    });
+    CHECK(visited == (std::vector<int>{4, 5, 6, 8}));
+    CHECK(*e == 10);
+
+    TestType empty;
+    CHECK(empty.visit([](auto) { return forest_descend; }) == empty.end());
+}
+
+// Check depth-tracking iteration against parent walks and filtered iteration.
+
+template <typename Forest>
+void check_depth_iteration(const Forest& f) {
+    using ivector = std::vector<int>;
+    using svector = std::vector<std::size_t>;
+
+    auto depth_of = [](auto i) {
+        std::size_t d = 0;
+        while ((i = i.parent())) ++d;
+        return d;
+    };
+
+    for (std::size_t max_depth: {std::size_t(0), std::size_t(1), std::size_t(2), Forest::no_depth_limit}) {
+        ivector pre, post;
+        svector pre_depth, post_depth;
+        for (auto i = f.preorder_begin(); i!=f.preorder_end(); ++i) {
+            if (depth_of(i)<=max_depth) pre.push_back(*i), pre_depth.push_back(depth_of(i));
+        }
+        for (auto i = f.postorder_begin(); i!=f.postorder_end(); ++i) {
+            if (depth_of(i)<=max_depth) post.push_back(*i), post_depth.push_back(depth_of(i));
+        }
+
+        ivector dpre, dpost;
+        svector dpre_depth, dpost_depth;
+        for (auto i = f.depth_preorder_begin(max_depth); i!=f.depth_preorder_end(); ++i) {
+            dpre.push_back(*i), dpre_depth.push_back(i.depth());
+        }
+        for (auto i = f.depth_postorder_begin(max_depth); i!=f.depth_postorder_end(); ++i) {
+            dpost.push_back(*i), dpost_depth.push_back(i.depth());
+        }
+
+        CHECK(dpre == pre);
+        CHECK(dpre_depth == pre_depth);
+        CHECK(dpost == post);
+        CHECK(dpost_depth == post_depth);
+    }
+
+    // Started at any node, depths and the depth limit are relative to it.
+    for (auto i = f.begin(); i!=f.end(); ++i) {
+        ivector children;
+        for (auto c = i.child(); c; c = c.next()) children.push_back(*c);
+
+        ivector pre, post;
+        svector pre_depth, post_depth;
+        for (typename Forest::const_depth_preorder_iterator j(i, 5, 6); j!=f.subtree_end(i); ++j) {
+            pre.push_back(*j), pre_depth.push_back(j.depth());
+        }
+        for (typename Forest::const_depth_postorder_iterator j(i, 0, 1); ; ++j) {
+            post.push_back(*j), post_depth.push_back(j.depth());
+            if (j==i) break;
+        }
+
+        ivector expected = children;
+        expected.insert(expected.begin(), *i);
+        svector expected_depth(expected.size(), 6);
+        expected_depth.front() = 5;
+        CHECK(pre == expected);
+        CHECK(pre_depth == expected_depth);
+
+        expected = children;
+        expected.push_back(*i);
+        expected_depth.assign(expected.size(), 1);
+        expected_depth.back() = 0;
+        CHECK(post == expected);
+        CHECK(post_depth == expected_depth);
+    }
+}
+
+TEMPLATE_TEST_CASE("depth iteration", "", ALL_FOREST_TYPES) {
+    TestType f = {{1, {2, 3}}, {4, {5, {6, {{7, {{10, {11}}}}}}, 8}}, 9};
+    check_depth_iteration(f);
+
+    std::vector<int> top;
+    for (auto i = f.depth_preorder_begin(0); i!=f.depth_preorder_end(); ++i) top.push_back(*i);
+    CHECK(top == (std::vector<int>{1, 4, 9}));
+
+    // Depths are relative to a starting node.
+    auto six = std::find(f.begin(), f.end(), 6);
+    typename TestType::depth_preorder_iterator i(six, 10);
+    CHECK(i.depth() == 10u);
+    CHECK(*++i == 7);
+    CHECK(i.depth() == 11u);
+    CHECK(*++i == 10);
+    CHECK(i.depth() == 12u);
+    CHECK(*i.skip_subtree() == 8);
+    CHECK(i.depth() == 10u);
+
+    TestType empty;
+    CHECK(empty.depth_preorder_begin() == empty.depth_preorder_end());
+    CHECK(empty.depth_postorder_begin(1) == empty.depth_postorder_end());
+}
+
+TEMPLATE_TEST_CASE("level order", "", ALL_FOREST_TYPES) {
+    using ivector = std::vector<int>;
+    using svector = std::vector<std::size_t>;
+
+    TestType f = {{1, {2, 3}}, {4, {5, {6, {7}}, 8}}, 9};
+    typename TestType::levelorder_frontier fr;
+
+    for (int pass = 0; pass<2; ++pass) {
+        ivector items;
+        svector levels;
+        for (auto i = f.levelorder_begin(fr); i!=f.levelorder_end(); ++i) {
+            items.push_back(*i);
+            levels.push_back(i.level());
+
+            std::size_t depth = 0;
+            for (auto a = i.parent(); a; a = a.parent()) ++depth;
+            CHECK(i.level() == depth);
+        }
+        CHECK(items == (ivector{1, 4, 9, 2, 3, 5, 6, 8, 7}));
+        CHECK(levels == (svector{0, 0, 0, 1, 1, 1, 1, 1, 2}));
+    }
+
+    const TestType& cf = f;
+    ivector citems(cf.levelorder_begin(fr), cf.levelorder_end());
+    CHECK(citems == (ivector{1, 4, 9, 2, 3, 5, 6, 8, 7}));
+
+    TestType empty;
+    CHECK(empty.levelorder_begin(fr) == empty.levelorder_end());
+}
+
+TEST_CASE("level order frontier reuse") {
+    simple_allocator<int> alloc;
+    using of = ordered_forest<int, simple_allocator<int>>;
+
+    of f(alloc);
+    auto i = f.push_front(0);
+    for (int k = 1; k<100; ++k) {
+        f.push_child(i, k);
+        if (k%10==0) i = i.child();
+    }
+
+    of::levelorder_frontier fr(alloc);
+    long long sum = 0;
+    for (auto j = f.levelorder_begin(fr); j!=f.levelorder_end(); ++j) sum += *j;
+    CHECK(sum == 4950);
+
+    alloc.reset_counts();
+    for (int pass = 0; pass<3; ++pass) {
+        sum = 0;
+        for (auto j = f.levelorder_begin(fr); j!=f.levelorder_end(); ++j) sum += *j;
+        CHECK(sum == 4950);
+    }
+    CHECK(alloc.n_alloc() == 0u);
+
+    fr.clear();
+    CHECK(alloc.n_dealloc() > 0u);
+}
+
+TEMPLATE_TEST_CASE("euler tour", "", ALL_FOREST_TYPES) {
+    using event = std::pair<int, bool>;
+    using evector = std::vector<event>;
+
+    TestType f = {{1, {2}}, {3, {4, {5, {6}}}}};
+
+    evector events;
+    for (auto i = f.euler_begin(); i!=f.euler_end(); ++i) events.push_back({*i, i.leaving()});
+
+    CHECK(events == (evector{
+        {1, false}, {2, false}, {2, true}, {1, true},
+        {3, false}, {4, false}, {4, true}, {5, false}, {6, false}, {6, true}, {5, true}, {3, true}}));
+
+    // Scoped state: depth from enter/leave events matches the parent walk.
+    std::size_t depth = 0;
+    for (auto i = f.euler_begin(); i!=f.euler_end(); ++i) {
+        if (i.leaving()) {
+            --depth;
+            continue;
+        }
+        std::size_t d = 0;
+        for (auto a = i.parent(); a; a = a.parent()) ++d;
+        CHECK(depth == d);
+        ++depth;
+    }
+    CHECK(depth == 0u);
+
+    auto five = std::find(f.begin(), f.end(), 5);
+    events.clear();
+    for (auto i = f.euler_begin(five); i!=f.euler_end(five); ++i) events.push_back({*i, i.leaving()});
+    CHECK(events == (evector{{5, false}, {6, false}, {6, true}, {5, true}}));
+
+    const TestType& cf = f;
+    auto two = std::find(cf.begin(), cf.end(), 2);
+    CHECK(std::distance(cf.euler_begin(two), cf.euler_end(two)) == 2);
+    CHECK(std::distance(cf.euler_begin(), cf.euler_end()) == 12);
+
+    TestType empty;
+    CHECK(empty.euler_begin() == empty.euler_end());
+}
+
+// Check prev() links and reverse iteration against forward iteration.
+
+template <typename Forest>
+void check_prev_links(Forest& f) {
+    using ivector = std::vector<int>;
+
+    for (auto i = f.begin(); i!=f.end(); ++i) {
+        typename Forest::iterator prev;
+        for (auto s = i.parent()? i.parent().child(): f.root_begin(); s!=i; s = s.next()) prev = s;
+        CHECK(i.prev() == prev);
+
+        ivector children(f.child_begin(i), f.child_end(i));
+        ivector rchildren(f.child_rbegin(i), f.child_rend(i));
+        CHECK(ivector(children.rbegin(), children.rend()) == rchildren);
+    }
+
+    ivector pre(f.preorder_begin(), f.preorder_end());
+    ivector rpre(f.preorder_rbegin(), f.preorder_rend());
+    CHECK(ivector(pre.rbegin(), pre.rend()) == rpre);
+
+    const Forest& cf = f;
+    ivector crpre(cf.crbegin(), cf.crend());
+    CHECK(crpre == rpre);
+
+    ivector post(f.postorder_begin(), f.postorder_end());
+    ivector rpost(f.postorder_rbegin(), f.postorder_rend());
+    CHECK(ivector(post.rbegin(), post.rend()) == rpost);
+
+    ivector roots(f.root_begin(), f.root_end());
+    ivector rroots(f.root_rbegin(), f.root_rend());
+    CHECK(ivector(roots.rbegin(), roots.rend()) == rroots);
+
+    // Decrement inverts increment on non-end iterators.
+    for (auto i = f.preorder_begin(); i!=f.preorder_end(); ++i) {
+        auto j = i;
+        if (++j) CHECK(--j == i);
+    }
+    for (auto i = f.postorder_begin(); i!=f.postorder_end(); ++i) {
+        auto j = i;
+        if (++j) CHECK(--j == i);
+    }
+}
+
+TEMPLATE_TEST_CASE("prev links", "", LINKED_FOREST_TYPES) {
+    using of = TestType;
+
+    of f = {{1, {2, 3}}, {4, {5, {6, {7}}, 8}}, 9};
+    check_prev_links(f);
+
+    f.insert_after(find_value(f, 2), 10);
+    f.push_child(find_value(f, 4), 11);
+    f.push_back_child(find_value(f, 4), 12);
+    f.push_front(13);
+    f.push_back(14);
+    check_prev_links(f);
+    CHECK(f == of{13, {1, {2, 10, 3}}, {4, {11, 5, {6, {7}}, 8, 12}}, 9, 14});
+
+    f.erase(find_value(f, 6));
+    check_prev_links(f);
+    f.erase(find_value(f, 13));
+    f.erase(find_value(f, 14));
+    f.erase(find_value(f, 10));
+    check_prev_links(f);
+    CHECK(f == of{{1, {2, 3}}, {4, {11, 5, 7, 8, 12}}, 9});
+
+    of p = f.prune(find_value(f, 11));
+    CHECK(p == of{11});
+    check_prev_links(p);
+    of q = f.prune(find_value(f, 12));
+    of r = f.prune(find_value(f, 7));
+    check_prev_links(f);
+    CHECK(f == of{{1, {2, 3}}, {4, {5, 8}}, 9});
+
+    f.graft_after(find_value(f, 5), std::move(p));
+    f.graft_child(find_value(f, 9), std::move(q));
+    f.graft_front(std::move(r));
+    check_prev_links(f);
+    CHECK(f == of{7, {1, {2, 3}}, {4, {5, 11, 8}}, {9, {12}}});
+
+    f.erase_child(find_value(f, 1));
+    f.erase_after(find_value(f, 5));
+    f.prune_front();
+    check_prev_links(f);
+    CHECK(f == of{{1, {3}}, {4, {5, 8}}, {9, {12}}});
+
+    f.move_front(find_value(f, 12));
+    check_prev_links(f);
+    f.move_child(find_value(f, 4), find_value(f, 12), find_value(f, 1));
+    check_prev_links(f);
+    f.move_after(find_value(f, 9), find_value(f, 5), find_value(f, 8));
+    check_prev_links(f);
+    CHECK(f == of{{4, {12, {1, {3}}}}, 9, 5, 8});
+
+    of h = {0, {1, {2, 3}}, 4, {5, {6}}, 7};
+    of hp = h.prune_range(find_value(h, 0), find_value(h, 4));
+    check_prev_links(h);
+    check_prev_links(hp);
+    h.erase_range(find_value(h, 0), find_value(h, 5));
+    check_prev_links(h);
+    h.splice_range(find_value(h, 6), hp, hp.begin(), find_value(hp, 4));
+    check_prev_links(h);
+    check_prev_links(hp);
+    CHECK(h == of{0, 6, 4, 7});
+    CHECK(hp == of{{1, {2, 3}}});
+    h.erase(find_value(h, 6), find_value(h, 7));
+    check_prev_links(h);
+    CHECK(h == of{0});
+
+    of g(f);
+    check_prev_links(g);
+    g.compact();
+    check_prev_links(g);
+    CHECK(g == f);
+
+    while (!g.empty()) {
+        g.erase(g.root_rbegin());
+        check_prev_links(g);
+    }
+    CHECK(g.rbegin() == g.rend());
+
+    REQUIRE_THROWS_AS(g.erase(g.end()), std::invalid_argument);
+}
+
+TEST_CASE("erase and prune at position") {
+    using of = ordered_forest<int>;
+    of f = {{1, {2, 3}}, {4, {5, {6, {7}}, 8}}, 9};
+
+    f.erase(std::find(f.begin(), f.end(), 6));
+    CHECK(f == of{{1, {2, 3}}, {4, {5, 7, 8}}, 9});
+
+    of p = f.prune(std::find(f.begin(), f.end(), 4));
+    CHECK(p == of{{4, {5, 7, 8}}});
+    CHECK(f == of{{1, {2, 3}}, 9});
+    CHECK(f.back() == 9);
+
+    f.prune(std::find(f.begin(), f.end(), 9));
+    CHECK(f.back() == 1);
+}
+
+// Check preorder escape links against the parent and sibling links.
+
+template <typename Forest>
+void check_threads(const Forest& f) {
+    std::size_t n = 0;
+    for (auto i = f.begin(); i!=f.end(); ++i, ++n) {
+        auto x = typename Forest::const_iterator(i);
+        while (x && !x.next()) x = x.parent();
+        CHECK(i.preorder_skip() == x.next());
+    }
+    CHECK(n == f.size());
+}
+
+TEMPLATE_TEST_CASE("preorder threads", "", THREADED_FOREST_TYPES) {
+    using of = TestType;
+
+    of f = {{1, {2, 3}}, {4, {{5, {{6, {{7, {{8, {9}}}}}}}}}}};
+    check_threads(f);
+
+    f.insert_after(find_value(f, 3), 10);
+    f.push_back_child(find_value(f, 8), 11);
+    f.push_back(12);
+    f.push_child(find_value(f, 9), 13);
+    check_threads(f);
+    CHECK(f == of{{1, {2, 3, 10}}, {4, {{5, {{6, {{7, {{8, {{9, {13}}, 11}}}}}}}}}}, 12});
+
+    f.erase(find_value(f, 12));
+    check_threads(f);
+    f.erase(find_value(f, 6));
+    check_threads(f);
+    f.erase(find_value(f, 11));
+    f.erase(find_value(f, 1));
+    check_threads(f);
+    CHECK(f == of{2, 3, 10, {4, {{5, {{7, {{8, {{9, {13}}}}}}}}}}});
+
+    of p = f.prune(find_value(f, 7));
+    check_threads(f);
+    check_threads(p);
+    CHECK(p == of{{7, {{8, {{9, {13}}}}}}});
+
+    of q = f.prune(find_value(f, 3));
+    check_threads(f);
+    f.graft_after(find_value(f, 2), std::move(p));
+    check_threads(f);
+    f.graft_child(find_value(f, 13), std::move(q));
+    check_threads(f);
+    CHECK(f == of{2, {7, {{8, {{9, {{13, {3}}}}}}}}, 10, {4, {5}}});
+
+    of g(f);
+    check_threads(g);
+    g.compact();
+    check_threads(g);
+    CHECK(g == f);
+
+    auto i = g.preorder_begin();
+    std::advance(i, 2);
+    CHECK(*i == 8);
+    i.skip_subtree();
+    CHECK(*i == 10);
+
+    while (!g.empty()) {
+        g.erase_front();
+        check_threads(g);
+    }
+}
+
+TEMPLATE_TEST_CASE("leaf and ancestor iteration", "", ALL_FOREST_TYPES) {
+    using of = TestType;
+    using ivector = std::vector<int>;
+
+    of e;
+    CHECK(e.leaf_begin() == e.leaf_end());
+
+    of f = {{1, {2, {3, {{4, {5, 6}}, 7}}}}, 8, {9, {{10, {11}}}}};
+    const of& cf = f;
+
+    CHECK(ivector(f.leaf_begin(), f.leaf_end()) == (ivector{2, 5, 6, 7, 8, 11}));
+    CHECK(ivector(cf.leaf_begin(), cf.leaf_end()) == (ivector{2, 5, 6, 7, 8, 11}));
+
+    for (auto i = f.begin(); i!=f.end(); ++i) {
+        ivector leaves;
+        for (auto j = f.subtree_postorder_begin(i); j!=f.subtree_postorder_end(i); ++j) {
+            if (!j.child()) leaves.push_back(*j);
+        }
+        CHECK(ivector(f.leaf_begin(i), f.leaf_end(i)) == leaves);
+
+        ivector path;
+        for (auto j = i.parent(); j; j = j.parent()) path.push_back(*j);
+        CHECK(ivector(f.ancestor_begin(i), f.ancestor_end(i)) == path);
+
+        ivector ranged;
+        for (auto& v: cf.ancestors(i)) ranged.push_back(v);
+        CHECK(ranged == path);
+    }
+
+    auto five = std::find(f.begin(), f.end(), 5);
+    CHECK(ivector(typename of::ancestor_iterator(five), f.ancestor_end(five)) == (ivector{5, 4, 3, 1}));
+
+    for (auto& v: f.ancestors(five)) v *= 10;
+    CHECK(f == of{{10, {2, {30, {{40, {5, 6}}, 7}}}}, 8, {9, {{10, {11}}}}});
+}
+
+TEMPLATE_TEST_CASE("prefetching iteration", "", ALL_FOREST_TYPES) {
+    using of = TestType;
+    using ivector = std::vector<int>;
+    typename of::prefetch_window w;
+
+    of e;
+    CHECK(e.prefetch_preorder_begin(w) == e.prefetch_preorder_end());
+    CHECK(e.prefetch_postorder_begin(w) == e.prefetch_postorder_end());
+
+    of f = {{1, {2, {3, {{4, {5, 6}}, 7}}}}, 8, {9, {{10, {11}}}}};
+    const of& cf = f;
+    ivector pre(f.preorder_begin(), f.preorder_end());
+    ivector post(f.postorder_begin(), f.postorder_end());
+
+    for (std::size_t distance: {0, 1, 3, 16, 100}) {
+        typename of::prefetch_window v(distance);
+        CHECK(v.distance() >= distance);
+        CHECK(ivector(f.prefetch_preorder_begin(v), f.prefetch_preorder_end()) == pre);
+        CHECK(ivector(cf.prefetch_preorder_begin(v), cf.prefetch_preorder_end()) == pre);
+        CHECK(ivector(f.prefetch_postorder_begin(v), f.prefetch_postorder_end()) == post);
+        CHECK(ivector(cf.prefetch_postorder_begin(v), cf.prefetch_postorder_end()) == post);
+    }
+
+    for (auto i = f.prefetch_preorder_begin(w); i!=f.prefetch_preorder_end(); ++i) *i += 100;
+    CHECK(f.front() == 101);
+    CHECK(f.back() == 109);
+}
+
+// Check parent() of every node against the child lists.
+
+template <typename Forest>
+void check_parents(const Forest& f) {
+    for (auto r = f.root_begin(); r!=f.root_end(); ++r) CHECK(!r.parent());
+    for (auto i = f.begin(); i!=f.end(); ++i) {
+        for (auto c = f.child_begin(i); c!=f.child_end(i); ++c) CHECK(c.parent() == i);
+    }
+}
+
+// Check a forest against its expected contents, and its links and order
+// statistics against its structure.
+
+template <typename Forest>
+void check_forest(const Forest& f, const Forest& expected) {
+    CHECK(f == expected);
+    if (!expected.empty()) CHECK(f.back() == expected.back());
+    check_order_statistics(f);
+    check_parents(f);
+    check_threads(f);
+}
+
+TEMPLATE_TEST_CASE("lazy parents", "", LAZY_FOREST_TYPES) {
+    using of = TestType;
+    using ivector = std::vector<int>;
+
+    of f = {{1, {2, {3, {4, 5, 6}}, 7}}, 8};
+    check_parents(f);
+
+    // Lift the children of 3 into the middle, then of 1 to the end.
+    f.erase(find_value(f, 3));
+    check_parents(f);
+    CHECK(f == of{{1, {2, 4, 5, 6, 7}}, 8});
+    f.erase(find_value(f, 8));
+    f.erase_front();
+    check_parents(f);
+    CHECK(f == of{2, 4, 5, 6, 7});
+
+    // Graft many roots into the middle and at the end of a child list.
+    auto nine = f.push_back(9);
+    f.graft_child(nine, of{10, 11});
+    f.graft_after(find_value(f, 10), of{12, 13, 14});
+    f.graft_after(find_value(f, 11), of{15, {16, {17}}});
+    check_parents(f);
+    CHECK(f == of{2, 4, 5, 6, 7, {9, {10, 12, 13, 14, 11, 15, {16, {17}}}}});
+
+    f.insert_after(find_value(f, 13), 18);
+    f.insert_after(find_value(f, 16), 19);
+    f.push_back_child(find_value(f, 9), 20);
+    check_parents(f);
+
+    // Remove the last and middle siblings, so that their predecessors and
+    // successors take up the parent.
+    f.erase_after(find_value(f, 19));
+    of p = f.prune_after(find_value(f, 15));
+    f.prune(find_value(f, 13));
+    f.erase(find_value(f, 11));
+    check_parents(f);
+    CHECK(f == of{2, 4, 5, 6, 7, {9, {10, 12, 18, 14, 15, 19}}});
+    CHECK(p == of{{16, {17}}});
+
+    CHECK(ivector(f.ancestor_begin(find_value(f, 12)), f.ancestor_end(find_value(f, 12))) == ivector{9});
+    CHECK(f.preorder_rank(find_value(f, 14)) == 9);
+    check_order_statistics(f);
+
+    of g(f);
+    check_parents(g);
+    g.compact();
+    check_parents(g);
+    CHECK(g == f);
+}
+
+TEMPLATE_TEST_CASE("move subtrees", "", ALL_FOREST_TYPES) {
+    using of = TestType;
+
+    of f = {{1, {2, 3, {4, {5, 6}}}}, {7, {8}}, 9};
+    auto four = find_value(f, 4);
+
+    CHECK(*f.move_after(find_value(f, 8), four) == 4);
+    check_forest(f, of{{1, {2, 3}}, {7, {8, {4, {5, 6}}}}, 9});
+
+    f.move_child(find_value(f, 9), find_value(f, 2));
+    check_forest(f, of{{1, {3}}, {7, {8, {4, {5, 6}}}}, {9, {2}}});
+
+    f.move_front(find_value(f, 6));
+    check_forest(f, of{6, {1, {3}}, {7, {8, {4, {5}}}}, {9, {2}}});
+
+    f.move_child(find_value(f, 2), find_value(f, 1), find_value(f, 7));
+    check_forest(f, of{6, {9, {{2, {{1, {3}}, {7, {8, {4, {5}}}}}}}}});
+
+    f.move_front(find_value(f, 3), find_value(f, 3));
+    check_forest(f, of{3, 6, {9, {{2, {1, {7, {8, {4, {5}}}}}}}}});
+
+    f.move_after(find_value(f, 5), find_value(f, 3), find_value(f, 6));
+    check_forest(f, of{{9, {{2, {1, {7, {8, {4, {5, 3, 6}}}}}}}}});
+
+    f.move_after(find_value(f, 9), find_value(f, 1), find_value(f, 7));
+    check_forest(f, of{{9, {2}}, 1, {7, {8, {4, {5, 3, 6}}}}});
+
+    // Iterators remain valid, and last-child links are maintained.
+    f.push_back_child(four, 10);
+    f.push_back(11);
+    check_forest(f, of{{9, {2}}, 1, {7, {8, {4, {5, 3, 6, 10}}}}, 11});
+
+    REQUIRE_THROWS_AS(f.move_front(f.end()), std::invalid_argument);
+    REQUIRE_THROWS_AS(f.move_after(f.end(), four), std::invalid_argument);
+}
+
+TEMPLATE_TEST_CASE("sibling ranges", "", ALL_FOREST_TYPES) {
+    using of = TestType;
+
+    of f = {{1, {2, 3, {4, {5, 6}}, 7}}, {8, {9}}, 10, 11};
+    auto seven = find_value(f, 7);
+
+    of p = f.prune_range(find_value(f, 2), find_value(f, 4));
+    check_forest(p, of{3, {4, {5, 6}}});
+    check_forest(f, of{{1, {2, 7}}, {8, {9}}, 10, 11});
+
+    f.erase_range(find_value(f, 1), find_value(f, 10));
+    check_forest(f, of{{1, {2, 7}}, 9, 11});
+
+    CHECK(*f.splice_range(seven, p, find_value(p, 3), find_value(p, 4)) == 4);
+    check_forest(f, of{{1, {2, 7, {4, {5, 6}}}}, 9, 11});
+    check_forest(p, of{3});
+
+    // Splicing within a forest moves the run in place.
+    CHECK(f.splice_range(find_value(f, 9), f, find_value(f, 2), seven) == seven);
+    check_forest(f, of{{1, {2, {4, {5, 6}}}}, 9, 7, 11});
+
+    of q = f.prune(find_value(f, 2), find_value(f, 4));
+    check_forest(q, of{2, {4, {5, 6}}});
+    check_forest(f, of{1, 9, 7, 11});
+
+    f.erase(find_value(f, 1), find_value(f, 9));
+    check_forest(f, of{7, 11});
+
+    // Erasing a run lifts the concatenation of its nodes' children.
+    of g = {{1, {0, {2, {3, 4}}, 5, {6, {7}}}}};
+    g.erase_range(find_value(g, 0), find_value(g, 6));
+    check_forest(g, of{{1, {0, 3, 4, 7}}});
+    g.push_back_child(find_value(g, 1), 8);
+    check_forest(g, of{{1, {0, 3, 4, 7, 8}}});
+
+    g.erase(find_value(g, 0), find_value(g, 4));
+    check_forest(g, of{{1, {7, 8}}});
+    g.erase(g.begin(), g.begin());
+    check_forest(g, of{7, 8});
+
+    of h = {{0, {1}}, {2, {{3, {4}}, 5}}, 6};
+    h.erase_range(find_value(h, 0), find_value(h, 6));
+    check_forest(h, of{{0, {1}}, {3, {4}}, 5});
+    h.push_back(7);
+    check_forest(h, of{{0, {1}}, {3, {4}}, 5, 7});
+
+    REQUIRE_THROWS_AS(h.erase_range(find_value(h, 7), find_value(h, 7)), std::invalid_argument);
+    REQUIRE_THROWS_AS(h.prune_range(find_value(h, 0), h.end()), std::invalid_argument);
+    REQUIRE_THROWS_AS(h.splice_range(h.end(), f, f.begin(), find_value(f, 11)), std::invalid_argument);
+    check_forest(f, of{7, 11});
+}
+
+TEMPLATE_TEST_CASE("node handles", "", ALL_FOREST_TYPES) {
+    using of = TestType;
+    using node_type = typename of::node_type;
+
+    of f = {{1, {2, 3, {4, {5, 6}}}}, {7, {8}}, 9};
+    auto one = find_value(f, 1);
+    auto four = find_value(f, 4);
+    CHECK(*one == 1);
+
+    node_type nh = f.extract(four);
+    REQUIRE(nh);
+    CHECK(nh.value() == 4);
+    CHECK(nh.size() == 3u);
+    check_forest(f, of{{1, {2, 3}}, {7, {8}}, 9});
+
+    // Reinsertion relinks the same nodes, and empties the handle.
+    CHECK(f.push_child(find_value(f, 7), std::move(nh)) == four);
+    CHECK(nh.empty());
+    check_forest(f, of{{1, {2, 3}}, {7, {{4, {5, 6}}, 8}}, 9});
+
+    // Between forests, nodes are relinked unless pooled (in which case the
+    // items are moved into new nodes), so iterators are found afresh.
+    of g;
+    CHECK(*g.push_front(f.extract(one)) == 1);
+    check_forest(f, of{{7, {{4, {5, 6}}, 8}}, 9});
+    check_forest(g, of{{1, {2, 3}}});
+
+    // Extracting a node alone lifts its children.
+    nh = f.extract_node(four);
+    CHECK(nh.size() == 1u);
+    check_forest(f, of{{7, {5, 6, 8}}, 9});
+    four = g.insert_after(g.begin(), std::move(nh));
+    CHECK(*four == 4);
+    check_forest(g, of{{1, {2, 3}}, 4});
+
+    node_type nh2 = g.extract_node(find_value(g, 3));
+    swap(nh, nh2);
+    CHECK(*g.push_child(four, std::move(nh)) == 3);
+    CHECK(!nh2);
+    check_forest(g, of{{1, {2}}, {4, {3}}});
+
+    nh = f.extract(find_value(f, 9));
+    CHECK(*f.insert_after(find_value(f, 8), std::move(nh)) == 9);
+    check_forest(f, of{{7, {5, 6, 8, 9}}});
+    f.push_back(10);
+    check_forest(f, of{{7, {5, 6, 8, 9}}, 10});
+
+    // Empty handles insert nothing.
+    auto seven = find_value(f, 7);
+    CHECK(f.insert_after(seven, node_type{}) == seven);
+    CHECK(f.push_child(seven, node_type{}) == seven);
+    CHECK(f.push_front(node_type{}) == f.end());
+    check_forest(f, of{{7, {5, 6, 8, 9}}, 10});
+
+    nh = f.extract(f.begin());
+    nh2 = f.extract(f.begin());
+    check_forest(f, of{});
+    f.push_front(std::move(nh));
+    f.push_front(std::move(nh2));
+    check_forest(f, of{10, {7, {5, 6, 8, 9}}});
+
+    REQUIRE_THROWS_AS(f.extract(f.end()), std::invalid_argument);
+    REQUIRE_THROWS_AS(f.extract_node(f.end()), std::invalid_argument);
+}
+
+TEST_CASE("node handle ownership") {
+    using item = std::unique_ptr<int>;
+    simple_allocator<item> alloc;
+
+    {
+        using of = ordered_forest<item, simple_allocator<item>>;
+        of f(alloc), g(alloc);
+        auto r = f.push_front(std::make_unique<int>(1));
+        auto c = f.push_child(r, std::make_unique<int>(2));
+        int* p = c->get();
+
+        // Moving a subtree between forests neither allocates nor touches items.
+        alloc.reset_counts();
+        g.push_front(f.extract(r));
+        CHECK(f.empty());
+        CHECK(g.size() == 2u);
+        CHECK(g.begin().child() == c);
+        CHECK(c->get() == p);
+        CHECK(alloc.n_alloc() == 0u);
+        CHECK(alloc.n_dealloc() == 0u);
+
+        // A discarded handle frees its nodes.
+        g.extract_node(r);
+        CHECK(g.size() == 1u);
+        CHECK(**g.begin() == 2);
+        CHECK(alloc.n_alloc() == 0u);
+        CHECK(alloc.n_dealloc() == 1u);
+    }
+    {
+        using of = ordered_forest<item, simple_allocator<item>, forest_node_pool>;
+        of f(alloc), g(alloc), h(alloc);
+        auto r = f.push_front(std::make_unique<int>(1));
+        int* p = f.push_child(r, std::make_unique<int>(2))->get();
+        g.push_front(std::make_unique<int>(3));
+
+        // Within a pool, nodes are relinked.
+        alloc.reset_counts();
+        CHECK(f.push_front(f.extract(r)) == r);
+        CHECK(alloc.n_alloc() == 0u);
+
+        // Between pools, items are moved into new nodes, and the handle's
+        // nodes released at once.
+        auto i = g.push_front(f.extract(r));
+        CHECK(f.empty());
+        CHECK(g.size() == 3u);
+        CHECK(i.child()->get() == p);
+        CHECK(alloc.n_alloc() == 0u);
+        f.shrink_to_fit();
+        CHECK(alloc.n_dealloc() == 1u);
+
+        // A forest without a pool acquires its own rather than sharing the
+        // handle's.
+        h.push_front(g.extract(i));
+        CHECK(g.size() == 1u);
+        CHECK(h.size() == 2u);
+        CHECK(alloc.n_alloc() > 0u);
+        CHECK(h.begin().child()->get() == p);
+    }
+}
+
+TEMPLATE_TEST_CASE("bulk construction", "", ALL_FOREST_TYPES) {
+    using of = TestType;
+    using ivector = std::vector<int>;
+    using svector = std::vector<std::size_t>;
+    constexpr std::size_t npos = of::npos;
+    auto check = [](of& f, const of& expected) {
+        check_forest(f, expected);
+        if (!f.empty()) {
+            // Last-child links are in place.
+            auto r = f.root_begin();
+            f.push_back_child(r, 100);
+            int last = 0;
+            for (auto c = f.child_begin(r); c!=f.child_end(r); ++c) last = *c;
+            CHECK(last == 100);
+            f.erase(find_value(f, 100));
+            CHECK(f == expected);
+        }
+    };
+
+    of f = {{1, {2, 3, {4, {5, 6}}}}, {7, {8}}, 9};
+    svector depths = f.preorder_depths();
+    svector parents = f.parent_indices();
+    CHECK(depths == (svector{0, 1, 1, 1, 2, 2, 0, 1, 0}));
+    CHECK(parents == (svector{npos, 0, 0, 0, 3, 3, npos, 6, npos}));
+
+    ivector values(f.begin(), f.end());
+    of g = of::from_preorder_depths(values, depths);
+    check(g, f);
+    of h = of::from_parent_indices(values, parents);
+    check(h, f);
+
+    // Parent indices need not follow preorder.
+    of k = of::from_parent_indices(ivector{5, 1, 4, 9, 2, 6, 3, 8, 7}, svector{2, npos, 1, npos, 1, 2, 1, 8, npos});
+    check(k, of{{1, {{4, {5, 6}}, 2, 3}}, 9, {7, {8}}});
+
+    of c = of::from_preorder_depths(ivector{1, 2, 3, 4}, svector{0, 1, 2, 3});
+    check(c, of{{1, {{2, {{3, {4}}}}}}});
+    of w = of::from_preorder_depths(ivector{1, 2, 3}, svector{0, 0, 0});
+    check(w, of{1, 2, 3});
+
+    of e = of::from_preorder_depths(ivector{}, svector{});
+    check(e, of{});
+    e = of::from_parent_indices(ivector{}, svector{});
+    check(e, of{});
+    CHECK(e.preorder_depths().empty());
+    CHECK(e.parent_indices().empty());
+
+    REQUIRE_THROWS_AS(of::from_preorder_depths(ivector{1, 2}, svector{0}), std::invalid_argument);
+    REQUIRE_THROWS_AS(of::from_parent_indices(ivector{1}, svector{}), std::invalid_argument);
+}
+
+TEST_CASE("bulk construction storage") {
+    using item = std::unique_ptr<int>;
+    simple_allocator<item> alloc;
+    using of = ordered_forest<item, simple_allocator<item>, forest_node_pool>;
+
+    std::vector<item> values;
+    std::vector<std::size_t> depths;
+    for (int k = 0; k<1000; ++k) {
+        values.push_back(std::make_unique<int>(k));
+        depths.push_back(k%3);
+    }
+
+    // Items are moved from an rvalue container, and a pooled forest
+    // allocates all its nodes at once.
+    alloc.reset_counts();
+    of f = of::from_preorder_depths(std::move(values), depths, alloc);
+    CHECK(f.size() == 1000u);
+    CHECK(alloc.n_alloc() <= 2u);
+    CHECK(f.preorder_depths() == depths);
+
+    int k = 0;
+    for (auto& x: f) CHECK(*x == k++);
+}
+
+TEST_CASE("bulk construction exception safety") {
+    struct throw_on_copy {
+        int n_;
+        throw_on_copy(int n): n_(n) {}
+        throw_on_copy(const throw_on_copy& x): n_(x.n_) {
+            if (n_<0) throw std::runtime_error("copy");
+        }
+    };
+
+    simple_allocator<throw_on_copy> alloc;
+    std::vector<throw_on_copy> values;
+    values.reserve(5);
+    for (int n: {1, 2, 3, -4, 5}) values.emplace_back(n);
+    std::vector<std::size_t> depths = {0, 1, 2, 1, 0};
+    std::vector<std::size_t> parents = {ordered_forest<throw_on_copy>::npos, 0, 1, 0, ordered_forest<throw_on_copy>::npos};
+
+    // Nodes made before the throw are reclaimed.
+    {
+        using of = ordered_forest<throw_on_copy, simple_allocator<throw_on_copy>>;
+        alloc.reset_counts();
+        REQUIRE_THROWS_AS(of::from_preorder_depths(values, depths, alloc), std::runtime_error);
+        CHECK(alloc.n_alloc() == 4u);
+        CHECK(alloc.n_dealloc() == 4u);
+
+        alloc.reset_counts();
+        REQUIRE_THROWS_AS(of::from_parent_indices(values, parents, alloc), std::runtime_error);
+        CHECK(alloc.n_alloc() == alloc.n_dealloc());
+    }
+    {
+        using of = ordered_forest<throw_on_copy, simple_allocator<throw_on_copy>, forest_node_pool|forest_preorder_thread>;
+        alloc.reset_counts();
+        REQUIRE_THROWS_AS(of::from_preorder_depths(values, depths, alloc), std::runtime_error);
+        REQUIRE_THROWS_AS(of::from_parent_indices(values, parents, alloc), std::runtime_error);
+        CHECK(alloc.n_alloc() == alloc.n_dealloc());
+    }
+}
+
+TEST_CASE("size") {
+    simple_allocator<int> alloc1, alloc2;
+    using of = ordered_forest<int, simple_allocator<int>>;
+
+    of f({1, {2, {3, {4, {5, 6}}}}, 7}, alloc1);
+    CHECK(f.size() == 7u);
+
+    auto two = std::find(f.begin(), f.end(), 2);
+    f.insert_after(two, 8);
+    f.push_child(two, 9);
+    CHECK(f.size() == 9u);
+
+    f.erase_after(std::find(f.begin(), f.end(), 3));
+    CHECK(f == of{1, {2, {9, 3, 5, 6}}, 8, 7});
+    CHECK(f.size() == 8u);
+
+    of p = f.prune_after(f.begin());
+    CHECK(p.size() == 5u);
+    CHECK(f.size() == 3u);
+
+    f.graft_front(std::move(p));
+    CHECK(f.size() == 8u);
+
+    f.graft_child(f.begin(), of({10, 11}, alloc2));
+    CHECK(f.size() == 10u);
+
+    of g(f);
+    CHECK(g.size() == 10u);
+
+    of h(std::move(g));
+    CHECK(h.size() == 10u);
+    CHECK(g.size() == 0u);
+
+    of e(alloc1);
+    swap(e, h);
+    CHECK(e.size() == 10u);
+    CHECK(h.size() == 0u);
+
+    e.clear();
+    CHECK(e.size() == 0u);
+}
+
 TEST_CASE("copy/move") {
     simple_allocator<int> alloc;
 
@@ -257,22 +1317,22 @@ TEST_CASE("copy/move") {
     of f1(alloc);
     {
         of f({{1, {2, 3}}, {4, {5, {6, {7}}, 8}}, 9}, alloc);
-        CHECK(alloc.n_alloc() == 18u);
+        CHECK(alloc.n_alloc() == 9u);
 
         f1 = f;
-        CHECK(alloc.n_alloc() == 36u);
+        CHECK(alloc.n_alloc() == 18u);
         CHECK(!f.empty());
 
         of f2 = std::move(f);
-        CHECK(alloc.n_alloc() == 36u);
+        CHECK(alloc.n_alloc() == 18u);
         CHECK(f.empty());
 
         ivector elems2{f2.begin(), f2.end()};
         CHECK(elems2 == ivector{1, 2, 3, 4, 5, 6, 7, 8, 9});
     }
 
-    CHECK(alloc.n_alloc() == 36u);
-    CHECK(alloc.n_dealloc() == 18u);
+    CHECK(alloc.n_alloc() == 18u);
+    CHECK(alloc.n_dealloc() == 9u);
 
     ivector elems1{f1.begin(), f1.end()};
     CHECK(elems1 == ivector{1, 2, 3, 4, 5, 6, 7, 8, 9});
@@ -289,30 +1349,79 @@ TEST_CASE("copy/move") {
     f3 = std::move(f1);
     CHECK(!f1.empty());
 
-    CHECK(alloc.n_alloc() == 36u);
-    CHECK(alloc.n_dealloc() == 18u);
-    CHECK(other_alloc.n_alloc() == 18u);
+    CHECK(alloc.n_alloc() == 18u);
+    CHECK(alloc.n_dealloc() == 9u);
+    CHECK(other_alloc.n_alloc() == 9u);
     CHECK(other_alloc.n_dealloc() == 0u);
 }
 
+TEST_CASE("copy shape") {
+    simple_allocator<int> alloc;
+    using of = ordered_forest<int, simple_allocator<int>>;
+
+    constexpr int n = 1000000;
+
+    of chain(alloc);
+    auto i = chain.push_front(0);
+    for (int k = 1; k<n; ++k) i = chain.push_child(i, k);
+
+    of chain_copy(chain);
+    CHECK(chain_copy == chain);
+    CHECK(!chain_copy.begin().parent());
+    CHECK(*std::find(chain_copy.begin(), chain_copy.end(), n-1).parent() == n-2);
+
+    of f({{1, {2, 3}}, {4, {5, {6, {7}}, 8}}, 9}, alloc);
+    of f_copy(f);
+    CHECK(f_copy == f);
+
+    auto seven = std::find(f_copy.begin(), f_copy.end(), 7);
+    CHECK(*seven.parent() == 6);
+    CHECK(*seven.parent().parent() == 4);
+    CHECK(!seven.parent().parent().parent());
+}
+
+TEST_CASE("copy exception safety") {
+    struct throw_on_copy {
+        int n_;
+        throw_on_copy(int n): n_(n) {}
+        throw_on_copy(const throw_on_copy& x): n_(x.n_) {
+            if (n_<0) throw std::runtime_error("copy");
+        }
+    };
+
+    simple_allocator<throw_on_copy> alloc;
+    using of = ordered_forest<throw_on_copy, simple_allocator<throw_on_copy>>;
+
+    {
+        of f({{1, {2, 3}}, {4, {5, {6, {7}}, 8}}, 9}, alloc);
+        std::find_if(f.begin(), f.end(), [](auto& x) { return x.n_==6; })->n_ = -6;
+
+        alloc.reset_counts();
+        // Six nodes allocated; five items copied before the throw.
+        REQUIRE_THROWS_AS(of(f), std::runtime_error);
+        CHECK(alloc.n_alloc() == 6u);
+        CHECK(alloc.n_dealloc() == 6u);
+    }
+}
+
 TEST_CASE("erase") {
     simple_allocator<int> alloc;
     using of = ordered_forest<int, simple_allocator<int>>;
 
     of f({1, 2, {3, {4, {5, {6, 7}}, 8}}, 9}, alloc);
-    CHECK(alloc.n_alloc() == 18u);
+    CHECK(alloc.n_alloc() == 9u);
 
     auto two = std::find(f.begin(), f.end(), 2);
     f.erase_after(two);
 
     CHECK(f == of{1, 2, 4, {5, {6, 7}}, 8, 9});
-    CHECK(alloc.n_dealloc() == 2u);
+    CHECK(alloc.n_dealloc() == 1u);
 
     auto five = std::find(f.begin(), f.end(), 5);
     f.erase_child(five);
 
     CHECK(f == of{1, 2, 4, {5, {7}}, 8, 9});
-    CHECK(alloc.n_dealloc() == 4u);
+    CHECK(alloc.n_dealloc() == 2u);
 
     auto eight = std::find(f.begin(), f.end(), 8);
     REQUIRE_THROWS_AS(f.erase_child(eight), std::invalid_argument);
@@ -322,7 +1431,15 @@ TEST_CASE("erase") {
 
     f.erase_front();
     CHECK(f == of{2, 4, {5, {7}}, 8, 9});
-    CHECK(alloc.n_dealloc() == 6u);
+    CHECK(alloc.n_dealloc() == 3u);
+
+    // Children of an erased last sibling are lifted into the parent.
+    f.erase_after(std::find(f.begin(), f.end(), 8));
+    f.erase_after(std::find(f.begin(), f.end(), 5));
+    CHECK(f == of{2, 4, {5, {7}}});
+    f.erase_after(std::find(f.begin(), f.end(), 4));
+    CHECK(f == of{2, 4, 7});
+    CHECK(!std::find(f.begin(), f.end(), 7).parent());
 
     of empty;
     REQUIRE_THROWS_AS(empty.erase_front(), std::invalid_argument);
@@ -333,7 +1450,7 @@ TEST_CASE("prune") {
     using of = ordered_forest<int, simple_allocator<int>>;
 
     of f({1, 2, {3, {4, {5, {6, 7}}, 8}}, 9}, alloc);
-    CHECK(alloc.n_alloc() == 18u);
+    CHECK(alloc.n_alloc() == 9u);
     CHECK(alloc.n_dealloc() == 0u);
 
     of p1 = f.prune_front();
@@ -377,6 +1494,7 @@ TEST_CASE("graft") {
 
     REQUIRE(j);
     CHECK(*j == 10);
+    CHECK(*j.parent() == 2);
     CHECK(f1 == of{1, 6, {7, {8}}, {2, {9, 10, 3, 4}}, 5});
 
     j = f1.graft_front(of{{11, {12, 13}}});
@@ -390,18 +1508,18 @@ TEST_CASE("graft") {
     of f3({3, 4}, alloc1);
     of f4({5, 6}, alloc2);
 
-    CHECK(alloc1.n_alloc() == 8);
+    CHECK(alloc1.n_alloc() == 4);
     CHECK(alloc1.n_dealloc() == 0);
-    CHECK(alloc2.n_alloc() == 4);
+    CHECK(alloc2.n_alloc() == 2);
 
     f2.graft_front(std::move(f3));
-    CHECK(alloc1.n_alloc() == 8);
+    CHECK(alloc1.n_alloc() == 4);
     CHECK(alloc1.n_dealloc() == 0);
 
     f2.graft_front(std::move(f4));
-    CHECK(alloc1.n_alloc() == 12);
+    CHECK(alloc1.n_alloc() == 6);
     CHECK(alloc1.n_dealloc() == 0);
-    CHECK(alloc2.n_dealloc() == 4);
+    CHECK(alloc2.n_dealloc() == 2);
 
     CHECK(f2 == of{5, 6, 3, 4, 1, 2});
 }
@@ -428,3 +1546,563 @@ TEST_CASE("swap") {
     CHECK(a == b_copy);
     CHECK(b == a_copy);
 }
+
+TEST_CASE("node pool") {
+    simple_allocator<int> alloc;
+    using of = ordered_forest<int, simple_allocator<int>, forest_node_pool>;
+
+    {
+        of f(alloc);
+        CHECK(alloc.n_alloc() == 0u);
+
+        // One allocation for the shared pool, one for the slab.
+        f.reserve(1000);
+        CHECK(alloc.n_alloc() == 2u);
+
+        auto i = f.push_front(0);
+        for (int k = 1; k<1000; ++k) i = f.push_child(i, k);
+        CHECK(f.size() == 1000u);
+        CHECK(alloc.n_alloc() == 2u);
+
+        // Freed nodes are recycled.
+        for (int k = 0; k<500; ++k) f.erase_front();
+        for (int k = 0; k<500; ++k) f.push_front(k);
+        CHECK(f.size() == 1000u);
+        CHECK(alloc.n_alloc() == 2u);
+        CHECK(alloc.n_dealloc() == 0u);
+
+        // The slab cannot be released while any of its nodes are live,
+        // including those in forests pruned from f.
+        of p = f.prune_front();
+        while (!f.empty()) f.erase_front();
+        f.shrink_to_fit();
+        CHECK(alloc.n_dealloc() == 0u);
+
+        p = of(alloc);
+        f.shrink_to_fit();
+        CHECK(alloc.n_dealloc() == 1u);
+
+        f.push_front(1);
+        CHECK(alloc.n_alloc() == 3u);
+    }
+
+    CHECK(alloc.n_alloc() == alloc.n_dealloc());
+}
+
+TEST_CASE("node pool graft") {
+    simple_allocator<int> alloc;
+    using of = ordered_forest<int, simple_allocator<int>, forest_node_pool>;
+
+    of f({1, {2, {3, 4}}, 5}, alloc);
+    auto n_alloc = alloc.n_alloc();
+
+    // Pruned trees share the pool, and can be grafted back without copying.
+    of p = f.prune_after(f.begin());
+    CHECK(p == of{{2, {3, 4}}});
+    f.graft_front(std::move(p));
+    CHECK(f == of{{2, {3, 4}}, 1, 5});
+    CHECK(alloc.n_alloc() == n_alloc);
+
+    // Trees from a different pool are copied into this one.
+    of g({6, 7}, alloc);
+    n_alloc = alloc.n_alloc();
+    f.graft_front(std::move(g));
+    CHECK(f == of{6, 7, {2, {3, 4}}, 1, 5});
+    CHECK(alloc.n_alloc() == n_alloc);
+
+    // Move assignment takes the pool along with the nodes.
+    of h(alloc);
+    h = std::move(f);
+    CHECK(h == of{6, 7, {2, {3, 4}}, 1, 5});
+    CHECK(alloc.n_alloc() == n_alloc);
+}
+
+TEST_CASE("clear") {
+    simple_allocator<int> alloc;
+
+    struct counted {
+        int n_;
+        std::size_t* dtor_count_;
+
+        counted(int n, std::size_t* c): n_(n), dtor_count_(c) {}
+        ~counted() { ++*dtor_count_; }
+    };
+
+    std::size_t n_dtor = 0;
+
+    {
+        ordered_forest<int, simple_allocator<int>> f({1, {2, {3, 4}}, 5}, alloc);
+        f.clear();
+        CHECK(f.empty());
+        CHECK(alloc.n_alloc() == alloc.n_dealloc());
+    }
+
+    {
+        using of = ordered_forest<int, simple_allocator<int>, forest_node_pool>;
+        alloc.reset_counts();
+
+        of f(alloc);
+        f.reserve(100);
+        auto i = f.push_front(0);
+        for (int k = 1; k<100; ++k) i = f.push_child(i, k);
+        REQUIRE(alloc.n_alloc() == 2u);
+
+        // Sole user of the pool: slabs are retained for reuse.
+        f.clear();
+        CHECK(f.empty());
+        CHECK(alloc.n_dealloc() == 0u);
+
+        for (int k = 0; k<100; ++k) f.push_front(k);
+        CHECK(f.size() == 100u);
+        CHECK(alloc.n_alloc() == 2u);
+
+        // With a pruned forest sharing the pool, its nodes must survive.
+        of p = f.prune_front();
+        f.clear();
+        CHECK(p == of{99});
+
+        f.shrink_to_fit();
+        CHECK(alloc.n_dealloc() == 0u);
+    }
+    CHECK(alloc.n_alloc() == alloc.n_dealloc());
+
+    {
+        using of = ordered_forest<counted, std::allocator<counted>, forest_node_pool>;
+
+        of f;
+        auto i = f.emplace_front(0, &n_dtor);
+        f.emplace_child(i, 1, &n_dtor);
+        f.emplace_child(i, 2, &n_dtor);
+
+        f.clear();
+        CHECK(n_dtor == 3u);
+
+        f.emplace_front(3, &n_dtor);
+        f.emplace_front(4, &n_dtor);
+    }
+    CHECK(n_dtor == 5u);
+}
+
+TEST_CASE("deep and wide destruction") {
+    constexpr int n = 10000000;
+    simple_allocator<int> alloc;
+
+    {
+        ordered_forest<int, simple_allocator<int>> chain(alloc);
+        auto i = chain.push_front(0);
+        for (int k = 1; k<n; ++k) i = chain.push_child(i, k);
+        REQUIRE(alloc.n_alloc() == std::size_t(n));
+    }
+    CHECK(alloc.n_dealloc() == std::size_t(n));
+
+    alloc.reset_counts();
+    {
+        ordered_forest<int, simple_allocator<int>> fan(alloc);
+        auto i = fan.push_front(0);
+        for (int k = 1; k<n; ++k) fan.push_child(i, k);
+        REQUIRE(alloc.n_alloc() == std::size_t(n));
+    }
+    CHECK(alloc.n_dealloc() == std::size_t(n));
+}
+
+TEMPLATE_TEST_CASE("order statistics", "", ALL_FOREST_TYPES) {
+    using of = TestType;
+
+    of f = {{1, {2, 3}}, {4, {5, {6, {7}}, 8}}, 9};
+    check_order_statistics(f);
+    CHECK(f.subtree_size(f.begin()) == 3u);
+    CHECK(f.subtree_size(std::find(f.begin(), f.end(), 4)) == 5u);
+    CHECK(*f.nth_preorder(6) == 7);
+    CHECK(f.preorder_rank(std::find(f.begin(), f.end(), 8)) == 7u);
+
+    auto six = std::find(f.begin(), f.end(), 6);
+    f.push_child(six, 10);
+    f.insert_after(six, 11);
+    check_order_statistics(f);
+    CHECK(f == of{{1, {2, 3}}, {4, {5, {6, {10, 7}}, 11, 8}}, 9});
+
+    f.erase_after(std::find(f.begin(), f.end(), 5));
+    check_order_statistics(f);
+    CHECK(f == of{{1, {2, 3}}, {4, {5, 10, 7, 11, 8}}, 9});
+
+    of p = f.prune_child(std::find(f.begin(), f.end(), 4));
+    check_order_statistics(f);
+    check_order_statistics(p);
+
+    f.graft_child(std::find(f.begin(), f.end(), 2), std::move(p));
+    check_order_statistics(f);
+    CHECK(f == of{{1, {{2, {5}}, 3}}, {4, {10, 7, 11, 8}}, 9});
+
+    f.graft_after(std::find(f.begin(), f.end(), 7), of{{12, {13, 14}}});
+    check_order_statistics(f);
+
+    of g(f);
+    check_order_statistics(g);
+    CHECK(g == f);
+
+    f.erase_front();
+    check_order_statistics(f);
+    CHECK(f == of{{2, {5}}, 3, {4, {10, 7, {12, {13, 14}}, 11, 8}}, 9});
+}
+
+TEMPLATE_TEST_CASE("push_back", "", ALL_FOREST_TYPES) {
+    using of = TestType;
+
+    of f;
+    auto a = f.push_back(1);
+    f.push_back_child(a, 2);
+    auto b = f.emplace_back(3);
+    f.push_back(4);
+    f.push_back_child(b, 5);
+    auto c = f.emplace_back_child(b, 6);
+    f.push_back_child(c, 7);
+
+    CHECK(f == of{{1, {2}}, {3, {5, {6, {7}}}}, 4});
+    CHECK(f.front() == 1);
+    CHECK(f.back() == 4);
+    check_order_statistics(f);
+
+    // Removing or lifting the last child must update the append position.
+
+    f.erase_after(std::find(f.begin(), f.end(), 5));
+    f.push_back_child(b, 8);
+    CHECK(f == of{{1, {2}}, {3, {5, 7, 8}}, 4});
+
+    of p = f.prune_after(std::find(f.begin(), f.end(), 7));
+    f.push_back_child(b, 9);
+    CHECK(f == of{{1, {2}}, {3, {5, 7, 9}}, 4});
+
+    f.erase_child(a);
+    f.push_back_child(a, 10);
+    CHECK(f == of{{1, {10}}, {3, {5, 7, 9}}, 4});
+
+    f.prune_after(b);
+    f.push_back(11);
+    CHECK(f == of{{1, {10}}, {3, {5, 7, 9}}, 11});
+    CHECK(f.back() == 11);
+
+    f.graft_after(std::find(f.begin(), f.end(), 9), std::move(p));
+    f.push_back_child(b, 12);
+    CHECK(f == of{{1, {10}}, {3, {5, 7, 9, 8, 12}}, 11});
+
+    f.graft_child(std::find(f.begin(), f.end(), 11), of{13, 14});
+    f.push_back_child(std::find(f.begin(), f.end(), 11), 15);
+    CHECK(f == of{{1, {10}}, {3, {5, 7, 9, 8, 12}}, {11, {13, 14, 15}}});
+
+    of g(f);
+    g.push_back_child(std::find(g.begin(), g.end(), 3), 16);
+    g.push_back(17);
+    CHECK(g == of{{1, {10}}, {3, {5, 7, 9, 8, 12, 16}}, {11, {13, 14, 15}}, 17});
+    check_order_statistics(g);
+
+    while (!g.empty()) g.erase_front();
+    g.push_back(18);
+    g.push_back(19);
+    CHECK(g == of{18, 19});
+}
+
+TEMPLATE_TEST_CASE("compact", "", ALL_FOREST_TYPES) {
+    using of = TestType;
+
+    of f;
+    auto i = f.push_front(0);
+    for (int k = 1; k<200; ++k) {
+        i = k%3? f.push_child(i, k): f.insert_after(i, k);
+    }
+    for (int k = 0; k<200; k += 2) {
+        auto j = std::find(f.begin(), f.end(), k);
+        if (j.child()) f.erase_child(j);
+    }
+
+    of expected(f);
+    f.compact();
+    CHECK(f == expected);
+    CHECK(f.size() == expected.size());
+    check_order_statistics(f);
+
+    // Relocated nodes remain fully linked.
+    for (auto j = f.begin(); j!=f.end(); ++j) {
+        for (auto c = j.child(); c; c = c.next()) CHECK(c.parent() == j);
+    }
+    f.push_back(1000);
+    f.push_back_child(f.begin(), 1001);
+    expected.push_back(1000);
+    expected.push_back_child(expected.begin(), 1001);
+    CHECK(f == expected);
+
+    of empty;
+    CHECK(empty.compact() == 0u);
+    CHECK(empty.empty());
+}
+
+TEST_CASE("compact storage") {
+    using of = ordered_forest<int, std::allocator<int>, forest_node_pool>;
+
+    of f;
+    for (int k = 0; k<1000; ++k) f.push_front(k);
+    for (int k = 0; k<1000; k += 4) f.push_child(std::find(f.begin(), f.end(), k), -k);
+    while (f.size()>100) f.erase_front();
+
+    of expected(f);
+    CHECK(f.compact() > 0u);
+    CHECK(f == expected);
+
+    // Nodes now lie in preorder in a single slab, at a constant stride.
+    std::vector<const char*> addr;
+    for (auto& x: f) addr.push_back(reinterpret_cast<const char*>(&x));
+
+    std::ptrdiff_t stride = addr[1]-addr[0];
+    CHECK(stride > 0);
+    for (std::size_t k = 1; k<addr.size(); ++k) CHECK(addr[k]-addr[k-1] == stride);
+
+    struct throw_on_copy {
+        int n_;
+        throw_on_copy(int n): n_(n) {}
+        throw_on_copy(const throw_on_copy& x): n_(x.n_) {
+            if (n_<0) throw std::runtime_error("copy");
+        }
+        bool operator==(const throw_on_copy& x) const { return n_==x.n_; }
+    };
+
+    simple_allocator<throw_on_copy> alloc;
+    using tf = ordered_forest<throw_on_copy, simple_allocator<throw_on_copy>>;
+
+    tf g({1, {2, {3, 4}}, 5}, alloc);
+    tf h(g);
+    auto four = std::find_if(g.begin(), g.end(), [](auto& x) { return x.n_==4; });
+    four->n_ = -4;
+
+    alloc.reset_counts();
+    REQUIRE_THROWS_AS(g.compact(), std::runtime_error);
+    four->n_ = 4;
+    CHECK(g == h);
+    CHECK(alloc.n_alloc() == alloc.n_dealloc());
+}
+
+TEST_CASE("indexed forest") {
+    using ix = indexed_forest<int>;
+    using of = ordered_forest<int>;
+
+    SECTION("editing") {
+        ix f{1, 2, {3, {4, {5, {6, 7}}, 8}}, 9};
+        CHECK(f.size() == 9u);
+        CHECK(f == ix(of{1, 2, {3, {4, {5, {6, 7}}, 8}}, 9}));
+
+        auto five = std::find(f.begin(), f.end(), 5);
+        CHECK(*five.parent() == 3);
+        CHECK(*five.child() == 6);
+        CHECK(*five.next() == 8);
+
+        f.insert_after(five, 10);
+        f.push_child(five, 11);
+        f.push_back_child(five, 12);
+        f.push_front(0);
+        f.push_back(13);
+        CHECK(f == ix{0, 1, 2, {3, {4, {5, {11, 6, 7, 12}}, 10, 8}}, 9, 13});
+        CHECK(f.front() == 0);
+        CHECK(f.back() == 13);
+
+        f.erase_child(std::find(f.begin(), f.end(), 3));
+        f.erase_after(std::find(f.begin(), f.end(), 10));
+        f.erase_front();
+        CHECK(f == ix{1, 2, {3, {{5, {11, 6, 7, 12}}, 10}}, 9, 13});
+        CHECK(f.size() == 11u);
+
+        ix p = f.prune_child(std::find(f.begin(), f.end(), 3));
+        CHECK(p == ix{{5, {11, 6, 7, 12}}});
+        CHECK(p.size() == 5u);
+
+        ix q = f.prune_after(std::find(f.begin(), f.end(), 9));
+        CHECK(q == ix{13});
+        CHECK(f.back() == 9);
+        CHECK(f == ix{1, 2, {3, {10}}, 9});
+        CHECK(f.size() == 5u);
+
+        auto j = f.graft_after(std::find(f.begin(), f.end(), 10), std::move(p));
+        CHECK(*j == 5);
+        j = f.graft_child(f.begin(), ix{14, 15});
+        CHECK(*j == 15);
+        j = f.graft_front(std::move(q));
+        CHECK(*j == 13);
+        CHECK(f == ix{13, {1, {14, 15}}, 2, {3, {10, {5, {11, 6, 7, 12}}}}, 9});
+        CHECK(f.size() == 13u);
+
+        std::vector<int> post(f.postorder_begin(), f.postorder_end());
+        CHECK(post == (std::vector<int>{13, 14, 15, 1, 2, 10, 11, 6, 7, 12, 5, 3, 9}));
+        check_subtree_iteration(f);
+        check_pruned_visit(f);
+        check_depth_iteration(f);
+
+        REQUIRE_THROWS_AS(f.erase_child(std::find(f.begin(), f.end(), 9)), std::invalid_argument);
+        REQUIRE_THROWS_AS(f.erase_after(std::find(f.begin(), f.end(), 9)), std::invalid_argument);
+
+        ix empty;
+        REQUIRE_THROWS_AS(empty.erase_front(), std::invalid_argument);
+    }
+
+    SECTION("reallocation") {
+        // Iterators survive growth of the node array, and insertion from an
+        // item in the same forest is safe.
+        ix f;
+        auto a = f.push_front(1);
+        auto b = f.push_child(a, 2);
+        for (int i = 3; i<=1000; ++i) f.push_back_child(b, *b+i);
+
+        CHECK(f.size() == 1000u);
+        CHECK(f.capacity() >= 1000u);
+        CHECK(*a == 1);
+        CHECK(*b == 2);
+        CHECK(*b.parent() == 1);
+
+        std::size_t cap = f.capacity();
+        while (f.size()<cap) f.push_back(f.front());
+        f.push_back(f.front());
+        CHECK(f.capacity() > cap);
+        CHECK(f.back() == 1);
+
+        // Erased slots are reused.
+        cap = f.capacity();
+        std::size_t n = f.size();
+        f.erase_child(b);
+        f.erase_child(b);
+        f.push_child(b, 3);
+        f.push_child(b, 4);
+        CHECK(f.size() == n);
+        CHECK(f.capacity() == cap);
+
+        f.clear();
+        CHECK(f.empty());
+        CHECK(f.capacity() == cap);
+    }
+
+    SECTION("non-trivial items") {
+        using sx = indexed_forest<std::string>;
+        std::string long_tail(40, '!');
+
+        sx f;
+        auto i = f.push_front("a"+long_tail);
+        for (int k = 0; k<100; ++k) i = f.push_child(i, std::to_string(k));
+
+        CHECK(f.size() == 101u);
+        CHECK(f.front() == "a"+long_tail);
+        CHECK(*i == "99");
+        CHECK(*i.parent() == "98");
+
+        sx g(f);
+        CHECK(g == f);
+
+        sx p = g.prune_child(g.begin());
+        CHECK(g == sx{"a"+long_tail});
+        CHECK(p.size() == 100u);
+
+        g = std::move(p);
+        CHECK(g.front() == "0");
+        CHECK(p.empty());
+    }
+
+    SECTION("allocation") {
+        simple_allocator<int> alloc;
+        using sx = indexed_forest<int, simple_allocator<int>>;
+
+        sx f(alloc);
+        f.reserve(100);
+        CHECK(alloc.n_alloc() == 1u);
+
+        auto i = f.push_front(0);
+        for (int k = 1; k<100; ++k) i = f.push_child(i, k);
+        CHECK(alloc.n_alloc() == 1u);
+
+        sx g(f);
+        CHECK(g == f);
+        CHECK(alloc.n_alloc() == 2u);
+
+        simple_allocator<int> other;
+        sx h(std::move(g), other);
+        CHECK(h == f);
+        CHECK(other.n_alloc() == 1u);
+    }
+
+    SECTION("exception safety") {
+        struct throw_on_copy {
+            int n_;
+            throw_on_copy(int n): n_(n) {}
+            throw_on_copy(const throw_on_copy& x): n_(x.n_) {
+                if (n_<0) throw std::runtime_error("copy");
+            }
+            bool operator==(const throw_on_copy& x) const { return n_==x.n_; }
+        };
+
+        using tx = indexed_forest<throw_on_copy>;
+        tx f;
+        auto i = f.push_front(1);
+        while (f.size()<f.capacity()) i = f.push_child(i, 2);
+
+        // Growth copies the existing items, as the move constructor may throw.
+        i->n_ = -1;
+        REQUIRE_THROWS_AS(f.push_back(3), std::runtime_error);
+        i->n_ = 2;
+
+        tx g(f);
+        CHECK(g == f);
+        CHECK(g.size() == f.size());
+    }
+}
+
+TEST_CASE("compact forest") {
+    using ivector = std::vector<int>;
+    using of = ordered_forest<int>;
+    using cf = compact_forest<int>;
+
+    of f = {{1, {2, 3}}, {4, {5, {6, {7}}, 8}}, 9};
+    cf c(f);
+
+    CHECK(c.size() == 9u);
+    CHECK(ivector(c.data(), c.data()+c.size()) == ivector{1, 2, 3, 4, 5, 6, 7, 8, 9});
+
+    ivector pre{c.preorder_begin(), c.preorder_end()};
+    CHECK(pre == ivector{1, 2, 3, 4, 5, 6, 7, 8, 9});
+
+    ivector post{c.postorder_begin(), c.postorder_end()};
+    CHECK(post == ivector{2, 3, 1, 5, 7, 6, 8, 4, 9});
+
+    const cf& cc = c;
+    ivector cpost{cc.postorder_begin(), cc.postorder_end()};
+    CHECK(cpost == post);
+
+    ivector root{c.root_begin(), c.root_end()};
+    CHECK(root == ivector{1, 4, 9});
+
+    auto four = std::find(c.begin(), c.end(), 4);
+    ivector child_four{c.child_begin(four), c.child_end(four)};
+    CHECK(child_four == ivector{5, 6, 8});
+
+    CHECK(c.subtree_size(four) == 5u);
+    CHECK(c.preorder_rank(four) == 3u);
+    CHECK(c.nth_preorder(3) == four);
+    CHECK(c.nth_preorder(9) == c.end());
+    CHECK(!four.parent());
+    CHECK(four.depth() == 0u);
+
+    auto seven = std::find(c.begin(), c.end(), 7);
+    CHECK(seven.depth() == 2u);
+    CHECK(*seven.parent() == 6);
+    CHECK(!seven.next());
+    CHECK(!seven.child());
+    CHECK(*seven.parent().next() == 8);
+
+    // Skipping subtrees visits only the roots.
+    ivector skipped;
+    for (auto i = c.begin(); i!=c.end(); i.skip_subtree()) skipped.push_back(*i);
+    CHECK(skipped == root);
+
+    *four = 10;
+    CHECK(c.to_forest() == (of{{1, {2, 3}}, {10, {5, {6, {7}}, 8}}, 9}));
+    CHECK(c != cf(f));
+
+    check_subtree_iteration(c);
+    check_pruned_visit(c);
+    check_depth_iteration(c);
+
+    CHECK(cf(of{}).empty());
+    CHECK(cf(of{}).begin() == cf(of{}).end());
+}